@@ -1,133 +1,2954 @@
 #include "sync_point.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <climits>
 #include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <mutex>
+#include <new>
+#include <optional>
+#include <sstream>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 
 #ifdef UNIT_TEST
 namespace utils {
 
+namespace {
+
+constexpr size_t kNoThread = SIZE_MAX;
+
+// index of the calling thread in the Explore pool
+thread_local size_t explore_worker = kNoThread;
+
+// Who hit a marker: the logical thread reported by the context provider,
+// or the OS thread when there is no provider or it reports 0.
+struct ExecutionContext {
+  std::thread::id thread;
+  uint64_t task = 0;
+
+  bool operator!=(const ExecutionContext& other) const { return thread != other.thread || task != other.task; }
+};
+
+// Layout of a multi-process graph segment: the header, then the points
+// sorted by name, then the predecessor indices of every point. Futex words
+// and pids are process-shared, hence lock-free atomics.
+constexpr uint32_t kSharedMagic = 0x53594e43;  // "SYNC"
+constexpr size_t kSharedNameSize = 112;
+constexpr size_t kMaxSharedProcesses = 64;
+// how often a blocked waiter checks that another process is still alive
+constexpr auto kSharedLivenessInterval = std::chrono::milliseconds(50);
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<int32_t>::is_always_lock_free);
+
+struct SharedPoint {
+  char name[kSharedNameSize];
+  uint32_t first_predecessor;
+  uint32_t num_predecessors;
+  std::atomic<uint32_t> cleared;  // futex word, 0 until the point is processed
+  std::atomic<uint32_t> waiters;
+};
+
+struct SharedHeader {
+  std::atomic<uint32_t> magic;  // published last by the creator
+  uint32_t num_points;
+  uint32_t num_edges;
+  int32_t creator;
+  std::atomic<int32_t> processes[kMaxSharedProcesses];  // attached pids, 0 when free
+};
+
+long Futex(std::atomic<uint32_t>* word, int op, uint32_t value, const timespec* timeout) {
+  return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), op, value, timeout, nullptr, 0);
+}
+
+bool ProcessAlive(int32_t pid) { return kill(pid, 0) == 0 || errno != ESRCH; }
+
+// Grace periods for the tables Process reads without the lock, as in RCU: a
+// reader holds a Guard while it uses a table, and a writer that replaced one
+// calls Synchronize before deleting the old copy. Readers count themselves
+// on cache line sized stripes, in the half picked by the current phase;
+// Synchronize flips the phase and waits for the old half to drain, which new
+// readers no longer join.
+class TableReaders {
+ private:
+  static constexpr size_t kStripes = 16;
+  struct alignas(64) Stripe {
+    std::atomic<uint32_t> count[2]{};
+  };
+  std::array<Stripe, kStripes> stripes_;
+  std::atomic<uint32_t> phase_ = 0;
+
+  static size_t StripeIndex() {
+    static std::atomic<size_t> next_stripe = 0;
+    thread_local size_t stripe = next_stripe++ % kStripes;
+    return stripe;
+  }
+
+ public:
+  class Guard {
+   private:
+    std::atomic<uint32_t>* count_;
+
+   public:
+    explicit Guard(TableReaders& readers)
+        : count_(&readers.stripes_[StripeIndex()].count[readers.phase_.load(std::memory_order_seq_cst) & 1]) {
+      count_->fetch_add(1, std::memory_order_seq_cst);
+    }
+    ~Guard() { count_->fetch_sub(1, std::memory_order_release); }
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+
+    // seq_cst, so a reader missed by Synchronize sees the newer table
+    template <typename Table>
+    const Table* Load(const std::atomic<const Table*>& table) const {
+      return table.load(std::memory_order_seq_cst);
+    }
+  };
+
+  // Returns once no reader can still use a table replaced before the call.
+  void Synchronize() {
+    uint32_t old = phase_.fetch_add(1, std::memory_order_seq_cst) & 1;
+    for (auto& stripe : stripes_) {
+      while (stripe.count[old].load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+      }
+    }
+  }
+};
+
+// Single pass parser of dependency specs, in the DSL or JSON form described
+// at SyncPoint::ParseDependencies. Names are interned so that each distinct
+// one is unescaped and copied once however many edges use it.
+class SpecParser {
+ private:
+  std::string_view spec_;
+  size_t pos_ = 0;
+  std::string error_;
+  std::unordered_map<std::string_view, size_t> ids_;
+  std::vector<std::string> names_;
+  // (predecessor, successor) ids
+  std::vector<std::pair<size_t, size_t>> dependencies_;
+  std::vector<std::pair<size_t, size_t>> markers_;
+
+ public:
+  explicit SpecParser(std::string_view spec) : spec_(spec) {
+    // generated specs spend most of their length on edges of a few dozen bytes
+    ids_.reserve(spec.size() / 32);
+    names_.reserve(spec.size() / 32);
+    dependencies_.reserve(spec.size() / 32);
+  }
+
+  bool Parse(std::vector<SyncPoint::SyncPointPair>* dependencies, std::vector<SyncPoint::SyncPointPair>* markers,
+             std::string* report) {
+    SkipSpace(true);
+    bool parsed = pos_ < spec_.size() && spec_[pos_] == '{' ? ParseJson() : ParseDsl();
+    if (!parsed) {
+      if (report != nullptr) {
+        *report = Position() + error_;
+      }
+      return false;
+    }
+    auto materialize = [this](const auto& edges, std::vector<SyncPoint::SyncPointPair>* pairs) {
+      pairs->clear();
+      pairs->reserve(edges.size());
+      for (const auto& [pred, succ] : edges) {
+        pairs->push_back({names_[pred], names_[succ]});
+      }
+    };
+    materialize(dependencies_, dependencies);
+    materialize(markers_, markers);
+    return true;
+  }
+
+ private:
+  bool Fail(const std::string& error) {
+    error_ = error;
+    return false;
+  }
+
+  std::string Position() const {
+    size_t line = 1;
+    size_t column = 1;
+    for (size_t i = 0; i < pos_ && i < spec_.size(); ++i) {
+      if (spec_[i] == '\n') {
+        line++;
+        column = 1;
+      } else {
+        column++;
+      }
+    }
+    return std::to_string(line) + ":" + std::to_string(column) + ": ";
+  }
+
+  size_t Intern(std::string_view raw, std::string name) {
+    auto [iter, inserted] = ids_.emplace(raw, names_.size());
+    if (inserted) {
+      names_.push_back(std::move(name));
+    }
+    return iter->second;
+  }
+
+  // skips blanks and '#' comments, and newlines too if `newlines`
+  void SkipSpace(bool newlines) {
+    while (pos_ < spec_.size()) {
+      char c = spec_[pos_];
+      if (c == '#') {
+        while (pos_ < spec_.size() && spec_[pos_] != '\n') {
+          pos_++;
+        }
+      } else if (c == ' ' || c == '\t' || c == '\r' || (newlines && c == '\n')) {
+        pos_++;
+      } else {
+        break;
+      }
+    }
+  }
+
+  bool Consume(std::string_view token) {
+    if (spec_.compare(pos_, token.size(), token) == 0) {
+      pos_ += token.size();
+      return true;
+    }
+    return false;
+  }
+
+  // A double quoted string with JSON escapes; `*raw` spans the quotes.
+  bool ParseString(std::string_view* raw, std::string* value) {
+    size_t begin = pos_++;
+    bool escaped = false;
+    while (pos_ < spec_.size() && spec_[pos_] != '"') {
+      escaped |= spec_[pos_] == '\\';
+      pos_ += spec_[pos_] == '\\' ? 2 : 1;
+    }
+    if (pos_ >= spec_.size()) {
+      pos_ = begin;
+      return Fail("unterminated string");
+    }
+    *raw = spec_.substr(begin, ++pos_ - begin);
+    if (!escaped) {
+      *value = std::string(raw->substr(1, raw->size() - 2));
+      return true;
+    }
+    value->clear();
+    for (size_t i = 1; i + 1 < raw->size(); ++i) {
+      char c = (*raw)[i];
+      if (c != '\\') {
+        value->push_back(c);
+        continue;
+      }
+      switch (c = (*raw)[++i]) {
+        case 'n':
+          value->push_back('\n');
+          break;
+        case 't':
+          value->push_back('\t');
+          break;
+        case 'r':
+          value->push_back('\r');
+          break;
+        case 'b':
+          value->push_back('\b');
+          break;
+        case 'f':
+          value->push_back('\f');
+          break;
+        case 'u': {
+          // exactly four hex digits; names are expected to be ASCII, other
+          // code points are kept as UTF-8
+          auto digits = i + 5 < raw->size() ? std::string(raw->substr(i + 1, 4)) : std::string();
+          if (digits.empty() ||
+              !std::all_of(digits.begin(), digits.end(), [](unsigned char c) { return std::isxdigit(c) != 0; })) {
+            return Fail("bad \\u escape");
+          }
+          unsigned code = std::stoul(digits, nullptr, 16);
+          i += 4;
+          if (code < 0x80) {
+            value->push_back(static_cast<char>(code));
+          } else if (code < 0x800) {
+            value->push_back(static_cast<char>(0xc0 | (code >> 6)));
+            value->push_back(static_cast<char>(0x80 | (code & 0x3f)));
+          } else {
+            value->push_back(static_cast<char>(0xe0 | (code >> 12)));
+            value->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+            value->push_back(static_cast<char>(0x80 | (code & 0x3f)));
+          }
+          break;
+        }
+        default:
+          value->push_back(c);
+      }
+    }
+    return true;
+  }
+
+  // a quoted name, or a run of characters up to a blank, ';', '#' or arrow
+  bool ParseName(size_t* id) {
+    if (pos_ < spec_.size() && spec_[pos_] == '"') {
+      std::string_view raw;
+      std::string name;
+      if (!ParseString(&raw, &name)) {
+        return false;
+      }
+      *id = Intern(raw, std::move(name));
+      return true;
+    }
+    size_t begin = pos_;
+    while (pos_ < spec_.size()) {
+      char c = spec_[pos_];
+      if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ';' || c == '#' ||
+          ((c == '-' || c == '=') && pos_ + 1 < spec_.size() && spec_[pos_ + 1] == '>')) {
+        break;
+      }
+      pos_++;
+    }
+    if (pos_ == begin) {
+      return Fail("expected a point name");
+    }
+    auto raw = spec_.substr(begin, pos_ - begin);
+    *id = Intern(raw, std::string(raw));
+    return true;
+  }
+
+  bool ParseDsl() {
+    while (true) {
+      SkipSpace(true);
+      if (pos_ >= spec_.size()) {
+        return true;
+      }
+      if (Consume(";")) {
+        continue;
+      }
+      bool marker_keyword = spec_.compare(pos_, 7, "marker ") == 0 || spec_.compare(pos_, 7, "marker\t") == 0;
+      if (marker_keyword) {
+        pos_ += 7;
+        SkipSpace(false);
+      }
+      size_t pred;
+      if (!ParseName(&pred)) {
+        return false;
+      }
+      size_t edges = 0;
+      while (true) {
+        SkipSpace(false);
+        bool marker = Consume("=>");
+        if (!marker && !Consume("->")) {
+          break;
+        }
+        if (marker_keyword && !marker) {
+          return Fail("expected '=>' after marker");
+        }
+        SkipSpace(false);
+        size_t succ;
+        if (!ParseName(&succ)) {
+          return false;
+        }
+        (marker ? markers_ : dependencies_).emplace_back(pred, succ);
+        pred = succ;
+        edges++;
+      }
+      if (edges == 0) {
+        return Fail("expected '->' or '=>'");
+      }
+      if (pos_ < spec_.size() && spec_[pos_] != ';' && spec_[pos_] != '\n') {
+        return Fail("expected ';' or a new line");
+      }
+    }
+  }
+
+  bool ParseJson() {
+    pos_++;
+    SkipSpace(true);
+    if (Consume("}")) {
+      return true;
+    }
+    while (true) {
+      if (pos_ >= spec_.size() || spec_[pos_] != '"') {
+        return Fail("expected a key");
+      }
+      std::string_view raw;
+      std::string key;
+      if (!ParseString(&raw, &key)) {
+        return false;
+      }
+      SkipSpace(true);
+      if (!Consume(":")) {
+        return Fail("expected ':'");
+      }
+      SkipSpace(true);
+      if (key == "dependencies" || key == "markers") {
+        if (!ParseJsonChains(key == "dependencies" ? dependencies_ : markers_)) {
+          return false;
+        }
+      } else {
+        return Fail("unknown key \"" + key + "\"");
+      }
+      SkipSpace(true);
+      if (Consume("}")) {
+        SkipSpace(true);
+        return pos_ >= spec_.size() || Fail("trailing characters");
+      }
+      if (!Consume(",")) {
+        return Fail("expected ',' or '}'");
+      }
+      SkipSpace(true);
+    }
+  }
+
+  // an array of chains, each an array of at least two names
+  bool ParseJsonChains(std::vector<std::pair<size_t, size_t>>& edges) {
+    if (!Consume("[")) {
+      return Fail("expected '['");
+    }
+    SkipSpace(true);
+    if (Consume("]")) {
+      return true;
+    }
+    while (true) {
+      if (!Consume("[")) {
+        return Fail("expected '[' starting a chain");
+      }
+      size_t length = 0;
+      size_t pred = 0;
+      while (true) {
+        SkipSpace(true);
+        if (pos_ >= spec_.size() || spec_[pos_] != '"') {
+          return Fail("expected a point name");
+        }
+        size_t succ;
+        if (!ParseName(&succ)) {
+          return false;
+        }
+        if (length++ > 0) {
+          edges.emplace_back(pred, succ);
+        }
+        pred = succ;
+        SkipSpace(true);
+        if (Consume("]")) {
+          break;
+        }
+        if (!Consume(",")) {
+          return Fail("expected ',' or ']'");
+        }
+      }
+      if (length < 2) {
+        return Fail("a chain needs at least two points");
+      }
+      SkipSpace(true);
+      if (Consume("]")) {
+        return true;
+      }
+      if (!Consume(",")) {
+        return Fail("expected ',' or ']'");
+      }
+      SkipSpace(true);
+    }
+  }
+};
+
+bool IsPattern(const std::string& name) { return name.find_first_of("*?") != std::string::npos; }
+
+size_t LiteralCount(const std::string& pattern) {
+  return pattern.size() - std::count(pattern.begin(), pattern.end(), '*') -
+         std::count(pattern.begin(), pattern.end(), '?');
+}
+
+// Glob patterns, where '*' matches any run of characters and '?' any one
+// character, compiled into a trie of literal characters and wildcards. A
+// point is matched against all patterns at once, as an NFA over the trie.
+class PatternTrie {
+ private:
+  struct Node {
+    std::vector<std::pair<char, uint32_t>> children;
+    uint32_t any = 0;   // '?' child, 0 if none
+    uint32_t star = 0;  // '*' child, 0 if none
+    // reached through '*', so any character stays here
+    bool loops = false;
+    std::vector<uint32_t> patterns;
+  };
+  std::vector<Node> nodes_{1};
+
+ public:
+  void Add(const std::string& pattern, uint32_t id) {
+    uint32_t node = 0;
+    for (char c : pattern) {
+      uint32_t next;
+      if (c == '*') {
+        if (nodes_[node].loops) {
+          continue;  // "**" is "*"
+        }
+        next = nodes_[node].star;
+      } else if (c == '?') {
+        next = nodes_[node].any;
+      } else {
+        auto& children = nodes_[node].children;
+        auto iter = std::find_if(children.begin(), children.end(), [c](const auto& child) { return child.first == c; });
+        next = iter != children.end() ? iter->second : 0;
+      }
+      if (next == 0) {
+        next = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+        nodes_[next].loops = c == '*';
+        if (c == '*') {
+          nodes_[node].star = next;
+        } else if (c == '?') {
+          nodes_[node].any = next;
+        } else {
+          nodes_[node].children.emplace_back(c, next);
+        }
+      }
+      node = next;
+    }
+    nodes_[node].patterns.push_back(id);
+  }
+
+  // ids of every pattern matching `point`
+  std::vector<uint32_t> Match(std::string_view point) const {
+    std::vector<uint32_t> current;
+    std::vector<uint32_t> next;
+    // a star matches the empty run too, so entering a node enters its star
+    auto enter = [this](std::vector<uint32_t>& states, uint32_t node) {
+      while (std::find(states.begin(), states.end(), node) == states.end()) {
+        states.push_back(node);
+        node = nodes_[node].star;
+        if (node == 0) {
+          return;
+        }
+      }
+    };
+    enter(current, 0);
+    for (char c : point) {
+      next.clear();
+      for (uint32_t node : current) {
+        const auto& n = nodes_[node];
+        if (n.loops) {
+          enter(next, node);
+        }
+        if (n.any != 0) {
+          enter(next, n.any);
+        }
+        for (const auto& [label, child] : n.children) {
+          if (label == c) {
+            enter(next, child);
+          }
+        }
+      }
+      current.swap(next);
+      if (current.empty()) {
+        return {};
+      }
+    }
+    std::vector<uint32_t> ids;
+    for (uint32_t node : current) {
+      ids.insert(ids.end(), nodes_[node].patterns.begin(), nodes_[node].patterns.end());
+    }
+    return ids;
+  }
+};
+
+// splitmix64, used both to seed and to step the per-thread PRNGs
+uint64_t SplitMix64(uint64_t& state) {
+  uint64_t z = (state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+// uniform in [0, 1)
+double NextUnit(uint64_t& state) { return static_cast<double>(SplitMix64(state) >> 11) * 0x1.0p-53; }
+
+// Allocation failure injection: the operator new call that takes the
+// calling thread's countdown to zero throws, 0 means disarmed. Process
+// parks the countdown in `paused_alloc_countdown` while it runs, so that
+// its own allocations are not counted and callbacks can re-arm it.
+thread_local uint64_t alloc_countdown = 0;
+thread_local uint64_t paused_alloc_countdown = 0;
+
+class AllocationPause {
+ private:
+  uint64_t outer_;
+
+ public:
+  AllocationPause() : outer_(paused_alloc_countdown) { paused_alloc_countdown = std::exchange(alloc_countdown, 0); }
+  ~AllocationPause() { alloc_countdown = std::exchange(paused_alloc_countdown, outer_); }
+  AllocationPause(const AllocationPause&) = delete;
+  AllocationPause& operator=(const AllocationPause&) = delete;
+};
+
+}  // namespace
+
 /************************************************************************/
 /* SyncPoint::Impl */
 /************************************************************************/
 class SyncPoint::Impl {
  private:
   std::atomic<bool> enabled_ = false;
+
+  // Chaos configuration, read by Process without taking mutex_. Every change
+  // publishes a new immutable table; a replaced one is deleted once the
+  // readers that may still see it are done (see TableReaders).
+  struct ChaosTable {
+    uint64_t seed = 0;
+    ChaosOptions defaults;
+    std::unordered_map<std::string, ChaosOptions> points;
+    // longest prefix first
+    std::vector<std::pair<std::string, ChaosOptions>> prefixes;
+    // bumped by EnableChaos, restarting the hit count of every thread
+    uint64_t epoch = 0;
+
+    const ChaosOptions& Lookup(const std::string& point) const {
+      auto iter = points.find(point);
+      if (iter != points.end()) {
+        return iter->second;
+      }
+      for (const auto& [prefix, options] : prefixes) {
+        if (point.compare(0, prefix.size(), prefix) == 0) {
+          return options;
+        }
+      }
+      return defaults;
+    }
+  };
+  std::atomic<const ChaosTable*> chaos_ = nullptr;
+  // master copy of the configuration, guarded by mutex_
+  ChaosTable chaos_config_;
+  std::unique_ptr<const ChaosTable> chaos_table_;
+
+  // Points enabled or disabled one by one, or by prefix. Published like the
+  // chaos table; null while no point has been configured.
+  struct EnabledTable {
+    std::unordered_map<std::string, bool> points;
+    // longest first
+    std::vector<std::pair<std::string, bool>> prefixes;
+
+    bool Enabled(const std::string& point) const {
+      auto iter = points.find(point);
+      if (iter != points.end()) {
+        return iter->second;
+      }
+      for (const auto& [prefix, enabled] : prefixes) {
+        if (point.compare(0, prefix.size(), prefix) == 0) {
+          return enabled;
+        }
+      }
+      return true;
+    }
+  };
+  std::atomic<const EnabledTable*> point_enabled_ = nullptr;
+  std::unique_ptr<const EnabledTable> enabled_table_;
+
+  // Callback filters resolved per point, published like the chaos table for
+  // Process to reject hits without the lock; null while there are no
+  // filters. A point has a filter only if nothing orders it, so a rejected
+  // hit would do nothing but skip the callbacks. Points not in the table take
+  // the lock, where they are collected for the next rebuild.
+  struct FilterTable {
+    std::unordered_map<std::string, std::optional<CallbackFilter>> points;
+
+    bool Rejects(const std::string& point, const std::vector<void*>& cb_args) const {
+      auto iter = points.find(point);
+      return iter != points.end() && iter->second.has_value() && !iter->second->Matches(cb_args);
+    }
+  };
+  std::atomic<const FilterTable*> filters_ = nullptr;
+  // the filters by callbacks_ key, the points seen and how many of them the
+  // published table resolves, guarded by mutex_
+  std::unordered_map<std::string, CallbackFilter> filter_config_;
+  std::unordered_set<std::string> filter_sites_;
+  size_t published_filter_sites_ = 0;
+  std::unique_ptr<const FilterTable> filter_table_;
+  TableReaders table_readers_;
   int num_callbacks_running_ = 0;
 
   std::unordered_map<std::string, std::vector<std::string>> successors_;
   std::unordered_map<std::string, std::vector<std::string>> predecessors_;
-  std::unordered_map<std::string, std::function<void(const std::vector<void*>&)>> callbacks_;
+  std::unordered_map<std::string, std::vector<SyncPointGroup>> predecessor_groups_;
+
+  // The callbacks of a point, highest priority first. A chain is never
+  // modified once published: Process takes a reference under mutex_ and
+  // runs it without, so adding or removing a callback copies the chain.
+  struct CallbackChain {
+    struct Entry {
+      int priority;
+      CallbackHandle handle;
+      ChainedCallback callback;
+    };
+    std::vector<Entry> entries;
+  };
+  std::unordered_map<std::string, std::shared_ptr<const CallbackChain>> callbacks_;
+  // the callbacks_ key of every handle
+  std::unordered_map<CallbackHandle, std::string> callback_points_;
+  CallbackHandle next_callback_handle_ = 0;
+
+  // Callbacks and dependency successors given as glob patterns, guarded by
+  // mutex_. A point is matched against the trie once and the result cached;
+  // the cache doubles as the registry of points seen, which is re-resolved
+  // whenever the patterns change, so hot points never walk the trie.
+  struct PatternMatch {
+    // the callbacks_ key of the most specific matching callback pattern
+    std::string callback;
+    // the predecessors_ / predecessor_groups_ keys matching the point
+    std::vector<std::string> successors;
+  };
+  std::vector<std::string> patterns_;
+  PatternTrie pattern_trie_;
+  std::unordered_map<std::string, PatternMatch> pattern_matches_;
+
+  // Fault injection state of a point, shared with the callback that
+  // decides. Deciding only touches the atomics, never mutex_.
+  struct FaultState {
+    FaultSpec spec;
+    CallbackHandle handle = 0;
+    std::atomic<uint64_t> hits = 0;
+    std::atomic<uint64_t> faults = 0;
+
+    // Returns whether this hit fails. The random draw is a hash of the seed
+    // and the hit index, so a sequence of hits is reproducible from the seed
+    // however the hits are spread over threads.
+    bool Decide() {
+      if (spec.thread != std::thread::id() && spec.thread != std::this_thread::get_id()) {
+        return false;
+      }
+      uint64_t hit = hits.fetch_add(1, std::memory_order_relaxed) + 1;
+      bool fail = hit == spec.nth_hit || (spec.every_k_hits > 0 && hit % spec.every_k_hits == 0);
+      if (!fail && spec.probability > 0) {
+        uint64_t state = spec.seed ^ (hit * 0xd1b54a32d192ed03);
+        fail = NextUnit(state) < spec.probability;
+      }
+      if (fail) {
+        faults.fetch_add(1, std::memory_order_relaxed);
+      }
+      return fail;
+    }
+  };
+  std::unordered_map<std::string, std::shared_ptr<FaultState>> faults_;
   std::unordered_map<std::string, std::vector<std::string>> markers_;
-  std::unordered_map<std::string, std::thread::id> marked_thread_id_;
+  std::unordered_map<std::string, ExecutionContext> marked_context_;
+  std::atomic<SyncPoint::ContextProvider> context_provider_{nullptr};
 
   std::mutex mutex_;
   std::condition_variable cv_;
   // sync points that have been passed through
   std::unordered_set<std::string> cleared_points_;
 
- public:
-  void EnableProcessing() { enabled_ = true; }
+  // Suspended awaiters keyed by point, guarded by mutex_. The thread that
+  // clears the last predecessor of a point processes it on the awaiter's
+  // behalf and then calls `resume` with the chain's action; reloading the
+  // graph or clearing the trace cancels them.
+  struct AsyncWaiter {
+    ExecutionContext context;
+    std::function<void(ProcessStatus, Action)> resume;
+  };
+  std::unordered_map<std::string, std::vector<AsyncWaiter>> async_waiters_;
+
+  // Multi-process mode: a mapped graph segment plus a process-local index
+  // from point name to its slot. Replaced graphs are unmapped only when
+  // the Impl is destroyed, as Process may still be reading them.
+  struct SharedGraph {
+    std::string name;
+    void* base = MAP_FAILED;
+    size_t size = 0;
+    SharedHeader* header = nullptr;
+    SharedPoint* points = nullptr;
+    const uint32_t* edges = nullptr;
+    std::unordered_map<std::string, uint32_t> index;
+    // the pid registered in `header->processes`, re-registered after fork
+    std::atomic<int32_t> registered{0};
+
+    ~SharedGraph() {
+      if (base != MAP_FAILED) {
+        munmap(base, size);
+      }
+    }
+  };
+  std::atomic<SharedGraph*> shared_ = nullptr;
+  std::atomic<SyncPoint::Remote*> remote_ = nullptr;
+  std::vector<std::unique_ptr<SharedGraph>> shared_graphs_;
+
+  // ProcessAsync completions, signalled on an eventfd whose counter batches
+  // any number of them into one wakeup.
+  std::mutex completion_mutex_;
+  int completion_fd_ = -1;
+  std::vector<std::function<void()>> completions_;
+
+  // Barriers, latches and semaphores keyed by point. Each parks its waiters
+  // on its own condition variable, so arrivals do not wake unrelated points.
+  struct RendezvousState {
+    RendezvousKind kind = RendezvousKind::kBarrier;
+    size_t count = 0;
+    // arrivals in the current generation; permits in use for a semaphore
+    size_t arrived = 0;
+    size_t generation = 0;
+    std::condition_variable cv;
+  };
+  std::unordered_map<std::string, RendezvousState> rendezvous_;
+  // semaphore release point -> acquire point
+  std::unordered_map<std::string, std::string> semaphore_releases_;
+
+  // Threads held by the step controller, each parked on its own condition
+  // variable in its Process frame so that a step wakes exactly that thread.
+  struct ParkSlot {
+    std::thread::id thread_id;
+    const std::string* point = nullptr;
+    bool released = false;
+    std::condition_variable cv;
+  };
+  std::unordered_set<std::string> hold_points_;
+  std::vector<ParkSlot*> parked_;
+  std::condition_variable parked_cv_;
+
+  // Serialising scheduler of Explore: exactly one pooled worker runs at a
+  // time, and every sync point it reaches is a scheduling decision. The
+  // trace is explored depth first, one re-execution of the body per leaf.
+  struct ExploreStep {
+    uint64_t enabled = 0;
+    // threads not worth running here, as an equivalent order was covered
+    uint64_t sleep = 0;
+    // choices explored so far, including `chosen`
+    uint64_t done = 0;
+    size_t chosen = kNoThread;
+    size_t previous = kNoThread;
+    size_t preemptions = 0;
+    // interned point each thread is parked at
+    std::vector<uint32_t> points;
+  };
+  struct ExploreState {
+    size_t num_threads = 0;
+    const std::function<void(size_t)>* body = nullptr;
+    const ExploreOptions* options = nullptr;
+    std::vector<ExploreStep> trace;
+    size_t depth = 0;
+    size_t last = kNoThread;
+    size_t preemptions = 0;
+    size_t running = kNoThread;
+    uint64_t waiting = 0;
+    uint64_t finished = 0;
+    bool deadlock = false;
+    bool stop = false;
+    size_t run = 0;
+    std::vector<uint32_t> pending;
+    std::vector<std::condition_variable> worker_cvs;
+    std::unordered_map<std::string, uint32_t> point_ids;
+    std::vector<std::string> point_names;
+    uint32_t start_point = 0;
+  };
+  ExploreState explore_;
+  std::condition_variable explore_done_cv_;
+
+  // A blocked Process call owns one slot of a preallocated table while it
+  // waits, so tracking costs a short scan and no allocation. Slots are taken
+  // and returned under mutex_, which also keeps `point` alive for readers.
+  struct WaiterSlot {
+    bool busy = false;
+    bool reported = false;
+    bool release = false;
+    std::thread::id thread_id;
+    const std::string* point = nullptr;
+    // set while parked at a barrier, latch or semaphore
+    const RendezvousState* rendezvous = nullptr;
+    std::chrono::steady_clock::time_point since;
+    // the wait condition, so virtual time can tell a waiter that is about to
+    // wake up from one that is blocked
+    const void* ready = nullptr;
+    bool (*ready_fn)(const void*) = nullptr;
+  };
+  static constexpr size_t kMaxWaiters = 256;
+  std::array<WaiterSlot, kMaxWaiters> waiters_;
+
+  // Virtual time, guarded by mutex_. Sleepers park on their own condition
+  // variable in their SleepFor frame.
+  struct Sleeper {
+    std::chrono::nanoseconds deadline{0};
+    bool woken = false;
+    std::condition_variable cv;
+  };
+  bool virtual_time_ = false;
+  // bumped by EnableVirtualTime, so threads of an earlier session that exit
+  // are not subtracted from `virtual_threads_`
+  size_t virtual_epoch_ = 0;
+  size_t virtual_threads_ = 0;
+  std::chrono::nanoseconds virtual_now_{0};
+  std::vector<Sleeper*> sleepers_;
+
+  std::thread watchdog_;
+  std::mutex watchdog_mutex_;
+  std::condition_variable watchdog_cv_;
+  bool watchdog_stop_ = false;
+
+ public:
+  ~Impl() {
+    DisableWatchdog();
+    if (completion_fd_ >= 0) {
+      close(completion_fd_);
+    }
+  }
+
+  void EnableProcessing() { enabled_ = true; }
+
+  void DisableProcessing() { enabled_ = false; }
+
+  void SetPointEnabled(const std::string& pattern, bool enabled) {
+    std::lock_guard lock(mutex_);
+    auto table = std::make_unique<EnabledTable>();
+    if (const auto* current = point_enabled_.load(std::memory_order_relaxed)) {
+      *table = *current;
+    }
+    if (!pattern.empty() && pattern.back() == '*') {
+      auto prefix = pattern.substr(0, pattern.size() - 1);
+      auto& prefixes = table->prefixes;
+      auto iter =
+          std::find_if(prefixes.begin(), prefixes.end(), [&](const auto& entry) { return entry.first == prefix; });
+      if (iter != prefixes.end()) {
+        iter->second = enabled;
+      } else {
+        prefixes.emplace_back(std::move(prefix), enabled);
+        std::stable_sort(prefixes.begin(), prefixes.end(),
+                         [](const auto& lhs, const auto& rhs) { return lhs.first.size() > rhs.first.size(); });
+      }
+    } else {
+      table->points[pattern] = enabled;
+    }
+    PublishTable<EnabledTable>(point_enabled_, enabled_table_, std::move(table));
+  }
+
+  void EnableChaos(uint64_t seed, const ChaosOptions& options) {
+    std::lock_guard lock(mutex_);
+    chaos_config_.seed = seed;
+    chaos_config_.defaults = options;
+    chaos_config_.epoch++;
+    PublishChaos(true);
+  }
+
+  void SetChaos(const std::string& pattern, const ChaosOptions& options) {
+    std::lock_guard lock(mutex_);
+    if (!pattern.empty() && pattern.back() == '*') {
+      auto prefix = pattern.substr(0, pattern.size() - 1);
+      auto& prefixes = chaos_config_.prefixes;
+      auto iter =
+          std::find_if(prefixes.begin(), prefixes.end(), [&](const auto& entry) { return entry.first == prefix; });
+      if (iter != prefixes.end()) {
+        iter->second = options;
+      } else {
+        prefixes.emplace_back(std::move(prefix), options);
+        std::stable_sort(prefixes.begin(), prefixes.end(),
+                         [](const auto& lhs, const auto& rhs) { return lhs.first.size() > rhs.first.size(); });
+      }
+    } else {
+      chaos_config_.points[pattern] = options;
+    }
+    PublishChaos(chaos_ != nullptr);
+  }
+
+  void DisableChaos() {
+    std::lock_guard lock(mutex_);
+    PublishChaos(false);
+  }
+
+  void SetContextProvider(SyncPoint::ContextProvider provider) {
+    context_provider_.store(provider, std::memory_order_release);
+  }
+
+  bool LoadDependencyAndMarkers(const std::vector<SyncPointPair>& dependencies,
+                                const std::vector<SyncPointPair>& markers, const std::vector<SyncPointGroup>& groups,
+                                std::string* report) {
+    std::string error;
+    if (!CheckDependencyAndMarkers(dependencies, markers, groups, &error)) {
+      if (report != nullptr) {
+        *report = std::move(error);
+      }
+      return false;
+    }
+    std::unique_lock lock(mutex_);
+    successors_.clear();
+    predecessors_.clear();
+    cleared_points_.clear();
+    predecessor_groups_.clear();
+    markers_.clear();
+    marked_context_.clear();
+    for (const auto& dependency : dependencies) {
+      successors_[dependency.predecessor].push_back(dependency.successor);
+      predecessors_[dependency.successor].push_back(dependency.predecessor);
+    }
+    for (const auto& marker : markers) {
+      successors_[marker.predecessor].push_back(marker.successor);
+      predecessors_[marker.successor].push_back(marker.predecessor);
+      markers_[marker.predecessor].push_back(marker.successor);
+    }
+    for (const auto& group : groups) {
+      for (const auto& pred : group.predecessors) {
+        successors_[pred].push_back(group.successor);
+      }
+      predecessor_groups_[group.successor].push_back(group);
+    }
+    CompilePatterns();
+    PublishFilters();
+    cv_.notify_all();
+    CancelAsync(lock);
+    return true;
+  }
+
+  void SetCallBack(const std::string& point, const CallbackFilter* filter, ChainedCallback callback) {
+    std::lock_guard lock(mutex_);
+    if (filter != nullptr) {
+      filter_config_[point] = *filter;
+      if (!IsPattern(point)) {
+        filter_sites_.insert(point);
+      }
+    } else {
+      filter_config_.erase(point);
+    }
+    auto iter = callbacks_.find(point);
+    if (iter != callbacks_.end()) {
+      for (const auto& entry : iter->second->entries) {
+        callback_points_.erase(entry.handle);
+      }
+      iter->second = std::make_shared<CallbackChain>();
+    }
+    AddEntry(point, std::move(callback), 0);
+    PublishFilters();
+  }
+
+  CallbackHandle AddCallBack(const std::string& point, ChainedCallback callback, int priority) {
+    std::lock_guard lock(mutex_);
+    return AddEntry(point, std::move(callback), priority);
+  }
+
+  bool RemoveCallBack(CallbackHandle handle) {
+    std::unique_lock lock(mutex_);
+    while (num_callbacks_running_ > 0) {
+      cv_.wait(lock);
+    }
+    return RemoveEntry(handle);
+  }
+
+  // The fault callback joins the chain of `point`, replacing only the
+  // callback of the previous SetFault there.
+  CallbackHandle SetFault(const std::string& point, const FaultSpec& spec) {
+    auto fault = std::make_shared<FaultState>();
+    fault->spec = spec;
+    std::lock_guard lock(mutex_);
+    auto& previous = faults_[point];
+    if (previous != nullptr) {
+      RemoveEntry(previous->handle);
+    }
+    previous = fault;
+    fault->handle = AddEntry(point, [fault](const std::vector<void*>& args) {
+      if (!fault->Decide()) {
+        return Action::kContinue;
+      }
+      if (fault->spec.on_fault) {
+        fault->spec.on_fault(args);
+      }
+      return fault->spec.action;
+    }, 0);
+    return fault->handle;
+  }
+
+  FaultStats GetFaultStats(const std::string& point) {
+    std::lock_guard lock(mutex_);
+    auto iter = faults_.find(point);
+    if (iter == faults_.end()) {
+      return {};
+    }
+    return {iter->second->hits.load(), iter->second->faults.load()};
+  }
+
+  void ClearCallBack(const std::string& point) {
+    std::unique_lock lock(mutex_);
+    while (num_callbacks_running_ > 0) {
+      cv_.wait(lock);
+    }
+    filter_config_.erase(point);
+    auto iter = callbacks_.find(point);
+    if (iter != callbacks_.end()) {
+      for (const auto& entry : iter->second->entries) {
+        callback_points_.erase(entry.handle);
+      }
+      callbacks_.erase(iter);
+      if (IsPattern(point)) {
+        CompilePatterns();
+      }
+    }
+    PublishFilters();
+  }
+
+  void ClearAllCallBacks() {
+    std::unique_lock lock(mutex_);
+    while (num_callbacks_running_ > 0) {
+      cv_.wait(lock);
+    }
+    callbacks_.clear();
+    callback_points_.clear();
+    filter_config_.clear();
+    if (!patterns_.empty()) {
+      CompilePatterns();
+    }
+    PublishFilters();
+  }
+
+  void EnableWatchdog(std::chrono::milliseconds deadline, WatchdogAction action) {
+    DisableWatchdog();
+    watchdog_stop_ = false;
+    watchdog_ = std::thread([this, deadline, action] { WatchdogLoop(deadline, action); });
+  }
+
+  void DisableWatchdog() {
+    if (!watchdog_.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard lock(watchdog_mutex_);
+      watchdog_stop_ = true;
+    }
+    watchdog_cv_.notify_all();
+    watchdog_.join();
+  }
+
+  std::string DumpWaiters() {
+    std::lock_guard lock(mutex_);
+    return WaitForReport(std::chrono::steady_clock::now(), nullptr);
+  }
+
+  void EnableVirtualTime(size_t num_threads) {
+    std::lock_guard lock(mutex_);
+    WakeSleepers();
+    virtual_time_ = true;
+    virtual_epoch_++;
+    virtual_threads_ = num_threads;
+    virtual_now_ = std::chrono::nanoseconds(0);
+  }
+
+  void DisableVirtualTime() {
+    std::lock_guard lock(mutex_);
+    virtual_time_ = false;
+    WakeSleepers();
+  }
+
+  std::chrono::nanoseconds VirtualNow() {
+    std::lock_guard lock(mutex_);
+    return virtual_now_;
+  }
+
+  void SleepFor(const std::string& point, std::chrono::nanoseconds duration) {
+    Process(point, {}, nullptr, nullptr, nullptr);
+    std::unique_lock lock(mutex_);
+    if (!virtual_time_) {
+      lock.unlock();
+      std::this_thread::sleep_for(duration);
+      return;
+    }
+    RegisterVirtualThread();
+    Sleeper sleeper;
+    sleeper.deadline = virtual_now_ + duration;
+    sleepers_.push_back(&sleeper);
+    AdvanceVirtualClock();
+    sleeper.cv.wait(lock, [&] { return sleeper.woken; });
+  }
+
+  void ClearTrace() {
+    std::unique_lock lock(mutex_);
+    cleared_points_.clear();
+    CancelAsync(lock);
+  }
+
+  ExploreResult Explore(size_t num_threads, const std::function<void()>& setup,
+                        const std::function<void(size_t)>& body, const std::function<bool()>& check,
+                        const ExploreOptions& options) {
+    ExploreResult result;
+    num_threads = std::min<size_t>(num_threads, 64);
+    auto& e = explore_;
+    {
+      std::lock_guard lock(mutex_);
+      e = ExploreState();
+      e.num_threads = num_threads;
+      e.body = &body;
+      e.options = &options;
+      e.pending.resize(num_threads);
+      e.worker_cvs = std::vector<std::condition_variable>(num_threads);
+      e.start_point = Intern("");
+    }
+    // the pool is reused by every run, only the schedule is reset
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < num_threads; ++i) {
+      workers.emplace_back([this, i] { ExploreWorker(i); });
+    }
+
+    bool more = true;
+    while (more && (options.max_schedules == 0 || result.schedules < options.max_schedules)) {
+      if (setup) {
+        setup();
+      }
+      {
+        std::unique_lock lock(mutex_);
+        cleared_points_.clear();
+        marked_context_.clear();
+        e.depth = 0;
+        e.last = kNoThread;
+        e.preemptions = 0;
+        e.finished = 0;
+        e.deadlock = false;
+        e.running = kNoThread;
+        e.waiting = 0;
+        e.run++;
+        for (auto& cv : e.worker_cvs) {
+          cv.notify_one();
+        }
+        explore_done_cv_.wait(lock, [&] { return e.finished == (uint64_t(1) << num_threads) - 1; });
+      }
+      result.schedules++;
+      bool passed = check();
+      std::lock_guard lock(mutex_);
+      if (!passed || e.deadlock) {
+        result.failed = true;
+        result.deadlock = e.deadlock;
+        for (size_t i = 0; i < e.depth; ++i) {
+          const auto& step = e.trace[i];
+          result.failing_schedule.push_back({step.chosen, e.point_names[step.points[step.chosen]]});
+        }
+        break;
+      }
+      more = Backtrack();
+    }
+
+    {
+      std::lock_guard lock(mutex_);
+      e.stop = true;
+      for (auto& cv : e.worker_cvs) {
+        cv.notify_one();
+      }
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    std::lock_guard lock(mutex_);
+    e = ExploreState();
+    return result;
+  }
+
+  std::vector<SyncPointPair> MinimizeDependencies(const std::vector<SyncPointPair>& dependencies,
+                                                  const std::function<bool()>& fails, size_t jobs,
+                                                  std::chrono::milliseconds timeout) {
+    jobs = std::max<size_t>(jobs, 1);
+    // the first failing candidate in order, or candidates.size(). Candidates
+    // that timed out or could not be forked run once more; if they are
+    // still inconclusive they are never chosen.
+    auto first_failing = [&](const std::vector<std::vector<SyncPointPair>>& candidates) {
+      for (size_t begin = 0; begin < candidates.size(); begin += jobs) {
+        size_t end = std::min(begin + jobs, candidates.size());
+        std::vector<pid_t> children;
+        for (size_t i = begin; i < end; ++i) {
+          children.push_back(ForkCandidate(candidates[i], fails));
+        }
+        auto results = WaitCandidates(children, timeout);
+        std::vector<size_t> retried;
+        children.clear();
+        for (size_t i = 0; i < results.size(); ++i) {
+          if (results[i] == CandidateResult::kInconclusive) {
+            retried.push_back(i);
+            children.push_back(ForkCandidate(candidates[begin + i], fails));
+          }
+        }
+        if (!retried.empty()) {
+          auto retry_results = WaitCandidates(children, timeout);
+          for (size_t i = 0; i < retried.size(); ++i) {
+            results[retried[i]] = retry_results[i];
+          }
+        }
+        for (size_t i = 0; i < results.size(); ++i) {
+          if (results[i] == CandidateResult::kFails) {
+            return begin + i;
+          }
+        }
+      }
+      return candidates.size();
+    };
+
+    if (first_failing({dependencies}) != 0) {
+      return dependencies;
+    }
+    if (first_failing(std::vector<std::vector<SyncPointPair>>(1)) == 0) {
+      return {};
+    }
+    std::vector<SyncPointPair> current = dependencies;
+    size_t granularity = 2;
+    while (current.size() >= 2) {
+      std::vector<std::vector<SyncPointPair>> subsets;
+      std::vector<std::vector<SyncPointPair>> complements;
+      for (size_t i = 0; i < granularity; ++i) {
+        size_t begin = current.size() * i / granularity;
+        size_t end = current.size() * (i + 1) / granularity;
+        subsets.emplace_back(current.begin() + begin, current.begin() + end);
+        complements.emplace_back(current.begin(), current.begin() + begin);
+        complements.back().insert(complements.back().end(), current.begin() + end, current.end());
+      }
+      std::vector<std::vector<SyncPointPair>> candidates = subsets;
+      if (granularity > 2) {
+        candidates.insert(candidates.end(), complements.begin(), complements.end());
+      }
+      size_t failing = first_failing(candidates);
+      if (failing < granularity) {
+        current = std::move(candidates[failing]);
+        granularity = 2;
+      } else if (failing < candidates.size()) {
+        current = std::move(candidates[failing]);
+        granularity = std::max<size_t>(granularity - 1, 2);
+      } else if (granularity >= current.size()) {
+        break;
+      } else {
+        granularity = std::min(granularity * 2, current.size());
+      }
+    }
+    return current;
+  }
+
+  // `deadline` and `cancelled` may be nullptr for an unbounded wait, and
+  // `action` if the site does not act on callbacks
+  ProcessStatus Process(const std::string& point, const std::vector<void*>& cb_args,
+                        const std::chrono::steady_clock::time_point* deadline, const std::atomic<bool>* cancelled,
+                        Action* action) {
+    if (!enabled_ || !PointEnabled(point) || FilterRejects(point, cb_args)) {
+      return ProcessStatus::kReleased;
+    }
+    AllocationPause allocation_pause;
+    if (chaos_.load(std::memory_order_relaxed) != nullptr) {
+      Perturb(point);
+    }
+    if (auto* shared = shared_.load(std::memory_order_acquire)) {
+      auto index_iter = shared->index.find(point);
+      if (index_iter != shared->index.end()) {
+        return ProcessShared(*shared, index_iter->second, cb_args, deadline, cancelled, action);
+      }
+    }
+    auto* remote = remote_.load(std::memory_order_acquire);
+    if (remote != nullptr) {
+      auto status = remote->Wait(point, deadline, cancelled);
+      if (status != ProcessStatus::kReleased) {
+        return status;
+      }
+    }
+    std::unique_lock lock(mutex_);
+    RegisterFilterSite(point);
+    if (virtual_time_) {
+      RegisterVirtualThread();
+    }
+    if (explore_worker != kNoThread) {
+      if (!explore_.deadlock) {
+        Yield(lock, Intern(point), explore_worker);
+      }
+      if (explore_.deadlock) {
+        return ProcessStatus::kReleased;
+      }
+    }
+    auto thread_id = std::this_thread::get_id();
+    auto marker_iter = markers_.find(point);
+    if (marker_iter != markers_.end()) {
+      auto context = CurrentContext();
+      for (auto& marked_point : marker_iter->second) {
+        marked_context_.emplace(marked_point, context);
+      }
+    }
+
+    if (DisabledByMarker(point)) {
+      return ProcessStatus::kDisabledByMarker;
+    }
+
+    auto status = Wait(lock, cv_, point, thread_id, nullptr, deadline, cancelled,
+                       [&] { return PredecessorsAllCleared(point); });
+    if (status == ProcessStatus::kReleased && !rendezvous_.empty()) {
+      status = ProcessRendezvous(lock, point, thread_id, deadline, cancelled);
+    }
+    if (status == ProcessStatus::kReleased && !hold_points_.empty() && hold_points_.count(point) > 0) {
+      status = Hold(lock, point, thread_id, deadline, cancelled);
+    }
+    if (status != ProcessStatus::kReleased) {
+      return status;
+    }
+
+    auto chain_action = RunCallBack(lock, point, cb_args);
+    if (action != nullptr) {
+      *action = chain_action;
+    }
+    cleared_points_.insert(point);
+    cv_.notify_all();
+    if (remote != nullptr) {
+      remote->Cleared(point);
+    }
+    if (!async_waiters_.empty()) {
+      DispatchAsync(lock, point);
+    }
+    return ProcessStatus::kReleased;
+  }
+
+  bool ProcessOrSuspend(const std::string& point, std::function<void(ProcessStatus, Action)> resume) {
+    if (!enabled_ || !PointEnabled(point) || FilterRejects(point, {})) {
+      return true;
+    }
+    AllocationPause allocation_pause;
+    // nothing would resume a suspended waiter once another process or the
+    // remote clears its predecessor, so those points are refused unless a
+    // shared point can go ahead right away
+    auto refuse = [&resume] {
+      if (resume) {
+        resume(ProcessStatus::kCancelled, Action::kContinue);
+      }
+      return false;
+    };
+    if (auto* shared = shared_.load(std::memory_order_acquire)) {
+      auto index_iter = shared->index.find(point);
+      if (index_iter != shared->index.end()) {
+        if (!SharedPredecessorsCleared(*shared, index_iter->second)) {
+          return refuse();
+        }
+        auto action = Action::kContinue;
+        ProcessShared(*shared, index_iter->second, {}, nullptr, nullptr, &action);
+        if (action != Action::kContinue) {
+          TakeAction(action, point);
+        }
+        return true;
+      }
+    }
+    if (remote_.load(std::memory_order_acquire) != nullptr) {
+      return refuse();
+    }
+    std::unique_lock lock(mutex_);
+    RegisterFilterSite(point);
+    auto context = CurrentContext();
+    auto marker_iter = markers_.find(point);
+    if (marker_iter != markers_.end()) {
+      for (auto& marked_point : marker_iter->second) {
+        marked_context_.emplace(marked_point, context);
+      }
+    }
+    if (DisabledByMarker(point)) {
+      return true;
+    }
+    if (!PredecessorsAllCleared(point)) {
+      if (resume) {
+        async_waiters_[point].push_back({context, std::move(resume)});
+      }
+      return false;
+    }
+    auto action = RunCallBack(lock, point, {});
+    cleared_points_.insert(point);
+    cv_.notify_all();
+    if (!async_waiters_.empty()) {
+      DispatchAsync(lock, point);
+    }
+    lock.unlock();
+    if (action != Action::kContinue) {
+      TakeAction(action, point);
+    }
+    return true;
+  }
+
+  void WakeWaiters() {
+    std::lock_guard lock(mutex_);
+    NotifyAllWaiters();
+  }
+
+  bool CreateSharedGraph(const std::string& name, const std::vector<SyncPointPair>& dependencies,
+                         std::string* report) {
+    std::string error;
+    if (!CheckDependencyAndMarkers(dependencies, {}, {}, &error)) {
+      return Fail(report, error);
+    }
+    std::vector<std::string> names;
+    for (const auto& dependency : dependencies) {
+      names.push_back(dependency.predecessor);
+      names.push_back(dependency.successor);
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    for (const auto& point : names) {
+      if (point.size() >= kSharedNameSize) {
+        return Fail(report, "point name too long for a shared graph: " + point);
+      }
+    }
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST && !SharedSegmentInUse(name)) {
+      shm_unlink(name.c_str());
+      fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if (fd < 0) {
+      return Fail(report, "cannot create shared graph " + name + ": " + strerror(errno));
+    }
+    size_t size = sizeof(SharedHeader) + names.size() * sizeof(SharedPoint) + dependencies.size() * sizeof(uint32_t);
+    auto graph = std::make_unique<SharedGraph>();
+    graph->name = name;
+    graph->size = size;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+      graph->base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (graph->base == MAP_FAILED) {
+      shm_unlink(name.c_str());
+      return Fail(report, "cannot map shared graph " + name + ": " + strerror(errno));
+    }
+
+    // ftruncate zero-fills, so every futex word and pid slot starts out clear
+    auto* header = static_cast<SharedHeader*>(graph->base);
+    auto* points = reinterpret_cast<SharedPoint*>(header + 1);
+    auto* edges = reinterpret_cast<uint32_t*>(points + names.size());
+    header->num_points = static_cast<uint32_t>(names.size());
+    header->num_edges = static_cast<uint32_t>(dependencies.size());
+    header->creator = getpid();
+    auto id = [&](const std::string& point) {
+      return static_cast<uint32_t>(std::lower_bound(names.begin(), names.end(), point) - names.begin());
+    };
+    auto sorted = dependencies;
+    std::sort(sorted.begin(), sorted.end(),
+              [](const auto& lhs, const auto& rhs) { return lhs.successor < rhs.successor; });
+    for (size_t i = 0; i < names.size(); ++i) {
+      memcpy(points[i].name, names[i].c_str(), names[i].size() + 1);
+    }
+    for (size_t i = 0; i < sorted.size(); ++i) {
+      auto& successor = points[id(sorted[i].successor)];
+      if (successor.num_predecessors++ == 0) {
+        successor.first_predecessor = static_cast<uint32_t>(i);
+      }
+      edges[i] = id(sorted[i].predecessor);
+    }
+    header->magic.store(kSharedMagic, std::memory_order_release);
+    return Install(std::move(graph), report);
+  }
+
+  bool AttachSharedGraph(const std::string& name, std::string* report) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+      return Fail(report, "cannot open shared graph " + name + ": " + strerror(errno));
+    }
+    struct stat st;
+    auto graph = std::make_unique<SharedGraph>();
+    graph->name = name;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(SharedHeader)) {
+      graph->size = static_cast<size_t>(st.st_size);
+      graph->base = mmap(nullptr, graph->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (graph->base == MAP_FAILED) {
+      return Fail(report, "cannot map shared graph " + name);
+    }
+    auto* header = static_cast<SharedHeader*>(graph->base);
+    if (header->magic.load(std::memory_order_acquire) != kSharedMagic ||
+        graph->size < sizeof(SharedHeader) + header->num_points * sizeof(SharedPoint) +
+                          header->num_edges * sizeof(uint32_t)) {
+      return Fail(report, "not a shared graph: " + name);
+    }
+    return Install(std::move(graph), report);
+  }
+
+  void SetRemote(SyncPoint::Remote* remote) { remote_.store(remote, std::memory_order_release); }
+
+  void DetachSharedGraph() {
+    std::lock_guard lock(mutex_);
+    auto* shared = shared_.exchange(nullptr, std::memory_order_acq_rel);
+    if (shared == nullptr) {
+      return;
+    }
+    int32_t self = getpid();
+    for (auto& process : shared->header->processes) {
+      int32_t expected = self;
+      process.compare_exchange_strong(expected, 0);
+    }
+    if (shared->header->creator == self) {
+      shm_unlink(shared->name.c_str());
+    }
+  }
+
+  int CompletionFd() {
+    std::lock_guard lock(completion_mutex_);
+    if (completion_fd_ < 0) {
+      completion_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (completion_fd_ < 0) {
+        fprintf(stderr, "SyncPoint: eventfd failed: errno %d\n", errno);
+        abort();
+      }
+    }
+    return completion_fd_;
+  }
+
+  void ProcessAsync(const std::string& point, std::function<void()> on_ready) {
+    int fd = CompletionFd();
+    // a deferred point's action is taken on the loop thread, before on_ready
+    auto complete = [this, fd, point, on_ready = std::move(on_ready)](ProcessStatus, Action action) mutable {
+      {
+        std::lock_guard lock(completion_mutex_);
+        if (action == Action::kContinue) {
+          completions_.push_back(std::move(on_ready));
+        } else {
+          completions_.push_back([action, point, on_ready = std::move(on_ready)] {
+            TakeAction(action, point);
+            on_ready();
+          });
+        }
+      }
+      uint64_t one = 1;
+      while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+      }
+    };
+    if (ProcessOrSuspend(point, complete)) {
+      complete(ProcessStatus::kReleased, Action::kContinue);
+    }
+  }
+
+  size_t RunCompletions() {
+    std::vector<std::function<void()>> completions;
+    {
+      std::lock_guard lock(completion_mutex_);
+      if (completion_fd_ < 0) {
+        return 0;
+      }
+      uint64_t count;
+      while (read(completion_fd_, &count, sizeof(count)) < 0 && errno == EINTR) {
+      }
+      completions.swap(completions_);
+    }
+    for (size_t i = 0; i < completions.size(); ++i) {
+      try {
+        completions[i]();
+      } catch (...) {
+        // requeue the rest of the batch for the next call
+        std::lock_guard lock(completion_mutex_);
+        completions_.insert(completions_.begin(), std::make_move_iterator(completions.begin() + i + 1),
+                            std::make_move_iterator(completions.end()));
+        if (!completions_.empty()) {
+          uint64_t one = 1;
+          while (write(completion_fd_, &one, sizeof(one)) < 0 && errno == EINTR) {
+          }
+        }
+        throw;
+      }
+    }
+    return completions.size();
+  }
+
+  void SetRendezvous(const std::string& point, RendezvousKind kind, size_t count,
+                     const std::string& release_point = {}) {
+    // nothing could ever complete a barrier of zero threads or acquire one
+    // of zero permits, and a latch of zero never blocks
+    if (count == 0) {
+      return;
+    }
+    std::lock_guard lock(mutex_);
+    auto& rendezvous = rendezvous_[point];
+    rendezvous.kind = kind;
+    rendezvous.count = count;
+    rendezvous.arrived = 0;
+    rendezvous.generation = 0;
+    if (kind == RendezvousKind::kSemaphore) {
+      semaphore_releases_[release_point] = point;
+    }
+    PublishFilters();
+  }
+
+  void HoldAt(const std::vector<std::string>& points) {
+    std::lock_guard lock(mutex_);
+    hold_points_.insert(points.begin(), points.end());
+    PublishFilters();
+  }
+
+  void ClearHolds() {
+    std::lock_guard lock(mutex_);
+    hold_points_.clear();
+    for (auto* slot : parked_) {
+      slot->released = true;
+      slot->cv.notify_one();
+    }
+    parked_.clear();
+    PublishFilters();
+  }
+
+  std::vector<ParkedThread> ParkedThreads() {
+    std::lock_guard lock(mutex_);
+    std::vector<ParkedThread> parked;
+    parked.reserve(parked_.size());
+    for (const auto* slot : parked_) {
+      parked.push_back({slot->thread_id, *slot->point});
+    }
+    return parked;
+  }
+
+  bool WaitForParked(size_t count, std::chrono::steady_clock::duration timeout) {
+    std::unique_lock lock(mutex_);
+    return parked_cv_.wait_for(lock, timeout, [&] { return parked_.size() >= count; });
+  }
+
+  bool Step(std::thread::id thread_id) {
+    std::lock_guard lock(mutex_);
+    for (auto iter = parked_.begin(); iter != parked_.end(); ++iter) {
+      if ((*iter)->thread_id == thread_id) {
+        (*iter)->released = true;
+        (*iter)->cv.notify_one();
+        parked_.erase(iter);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void ClearRendezvous() {
+    std::lock_guard lock(mutex_);
+    rendezvous_.clear();
+    semaphore_releases_.clear();
+    PublishFilters();
+  }
+
+ private:
+  bool PointEnabled(const std::string& point) {
+    if (point_enabled_.load(std::memory_order_relaxed) == nullptr) {
+      return true;
+    }
+    TableReaders::Guard guard(table_readers_);
+    const auto* table = guard.Load(point_enabled_);
+    return table == nullptr || table->Enabled(point);
+  }
+
+  // Whether a hit can be dropped before the lock. Chaos, exploration and
+  // cross-process ordering act on every hit, so they take the slow path.
+  bool FilterRejects(const std::string& point, const std::vector<void*>& cb_args) {
+    if (filters_.load(std::memory_order_relaxed) == nullptr || explore_worker != kNoThread ||
+        chaos_.load(std::memory_order_relaxed) != nullptr || shared_.load(std::memory_order_relaxed) != nullptr ||
+        remote_.load(std::memory_order_relaxed) != nullptr) {
+      return false;
+    }
+    TableReaders::Guard guard(table_readers_);
+    const auto* table = guard.Load(filters_);
+    return table != nullptr && table->Rejects(point, cb_args);
+  }
+
+  // Requires mutex_. Records a point taking the slow path. The table is
+  // rebuilt once the new points outnumber those it resolves, so a stream of
+  // new names costs amortised O(1) each.
+  void RegisterFilterSite(const std::string& point) {
+    if (filters_.load(std::memory_order_relaxed) != nullptr && filter_sites_.insert(point).second &&
+        filter_sites_.size() >= 2 * published_filter_sites_) {
+      PublishFilters();
+    }
+  }
+
+  // Requires mutex_. Publishes `table` in `current`, owned by `owner`, and
+  // deletes the table it replaces once no reader can still use it.
+  template <typename Table>
+  void PublishTable(std::atomic<const Table*>& current, std::unique_ptr<const Table>& owner,
+                    std::unique_ptr<const Table> table) {
+    current.store(table.get(), std::memory_order_seq_cst);
+    if (owner != nullptr) {
+      table_readers_.Synchronize();
+    }
+    owner = std::move(table);
+  }
+
+  // Requires mutex_. Re-resolves the filter table, after the callbacks, the
+  // filters or the graph changed.
+  void PublishFilters() {
+    if (filter_config_.empty()) {
+      filter_sites_.clear();
+      published_filter_sites_ = 0;
+      PublishTable(filters_, filter_table_, {});
+      return;
+    }
+    published_filter_sites_ = filter_sites_.size();
+    auto table = std::make_unique<FilterTable>();
+    for (const auto& point : filter_sites_) {
+      auto& filter = table->points[point];
+      if (Ordered(point)) {
+        continue;
+      }
+      const std::string* key = &point;
+      if (callbacks_.count(point) == 0) {
+        const auto* match = MatchPatterns(point);
+        if (match == nullptr || match->callback.empty()) {
+          continue;
+        }
+        key = &match->callback;
+      }
+      auto iter = filter_config_.find(*key);
+      if (iter != filter_config_.end()) {
+        filter = iter->second;
+      }
+    }
+    PublishTable<FilterTable>(filters_, filter_table_, std::move(table));
+  }
+
+  // Requires mutex_. Whether Process does more for `point` than run its
+  // callbacks.
+  bool Ordered(const std::string& point) {
+    if (successors_.count(point) > 0 || predecessors_.count(point) > 0 || predecessor_groups_.count(point) > 0 ||
+        markers_.count(point) > 0 || hold_points_.count(point) > 0 || rendezvous_.count(point) > 0 ||
+        semaphore_releases_.count(point) > 0) {
+      return true;
+    }
+    const auto* match = MatchPatterns(point);
+    return match != nullptr && !match->successors.empty();
+  }
+
+  // Requires mutex_.
+  void PublishChaos(bool enabled) {
+    if (!enabled) {
+      PublishTable(chaos_, chaos_table_, {});
+      return;
+    }
+    auto table = std::make_unique<ChaosTable>();
+    table->seed = chaos_config_.seed;
+    table->epoch = chaos_config_.epoch;
+    table->defaults = chaos_config_.defaults;
+    table->points = chaos_config_.points;
+    table->prefixes = chaos_config_.prefixes;
+    PublishTable<ChaosTable>(chaos_, chaos_table_, std::move(table));
+  }
+
+  // Yields, spins or sleeps as drawn from the calling thread's PRNG.
+  // The draws of a hit depend only on the seed, the point, the task id of
+  // the context provider and how many points the thread has hit since chaos
+  // was enabled, never on the order in which threads arrive.
+  void Perturb(const std::string& point) {
+    thread_local uint64_t epoch = 0;
+    thread_local uint64_t hits = 0;
+    auto provider = context_provider_.load(std::memory_order_acquire);
+    uint64_t task = provider != nullptr ? provider() : 0;
+    uint64_t state;
+    ChaosOptions options;
+    {
+      // the table is only read under the guard, not while perturbing
+      TableReaders::Guard guard(table_readers_);
+      const auto* chaos = guard.Load(chaos_);
+      if (chaos == nullptr) {
+        return;
+      }
+      if (epoch != chaos->epoch) {
+        epoch = chaos->epoch;
+        hits = 0;
+      }
+      state = chaos->seed ^ (std::hash<std::string>()(point) * 0x9e3779b97f4a7c15) ^ (++hits * 0xbf58476d1ce4e5b9) ^
+              (task * 0x94d049bb133111eb);
+      options = chaos->Lookup(point);
+    }
+    double draw = NextUnit(state);
+    if ((draw -= options.yield_probability) < 0) {
+      std::this_thread::yield();
+    } else if ((draw -= options.spin_probability) < 0) {
+      auto until = std::chrono::steady_clock::now() +
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(options.max_spin * NextUnit(state));
+      while (std::chrono::steady_clock::now() < until) {
+      }
+    } else if ((draw -= options.sleep_probability) < 0) {
+      std::this_thread::sleep_for(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(options.max_sleep * NextUnit(state)));
+    }
+  }
+
+  // Parks on `cv` until `ready()` holds, tracking the waiter for the
+  // watchdog. Returns kReleased, or why the waiter gave up instead.
+  template <typename Ready>
+  ProcessStatus Wait(std::unique_lock<std::mutex>& lock, std::condition_variable& cv, const std::string& point,
+                     std::thread::id thread_id, const RendezvousState* rendezvous,
+                     const std::chrono::steady_clock::time_point* deadline, const std::atomic<bool>* cancelled,
+                     Ready ready) {
+    if (ready()) {
+      return ProcessStatus::kReleased;
+    }
+    WaiterSlot* slot = AcquireWaiterSlot(point, thread_id, rendezvous);
+    if (slot != nullptr) {
+      slot->ready = &ready;
+      slot->ready_fn = [](const void* ready) { return (*static_cast<const Ready*>(ready))(); };
+    }
+    if (virtual_time_) {
+      RegisterVirtualThread();
+      AdvanceVirtualClock();
+    }
+    auto status = ProcessStatus::kReleased;
+    while (!ready()) {
+      if (cancelled != nullptr && *cancelled) {
+        status = ProcessStatus::kCancelled;
+        break;
+      }
+      if (deadline == nullptr) {
+        cv.wait(lock);
+      } else if (cv.wait_until(lock, *deadline) == std::cv_status::timeout && !ready()) {
+        status = ProcessStatus::kTimedOut;
+        break;
+      }
+      if (DisabledByMarker(point)) {
+        status = ProcessStatus::kDisabledByMarker;
+        break;
+      }
+      if (slot != nullptr && slot->release) {
+        status = ProcessStatus::kTimedOut;
+        break;
+      }
+    }
+    if (slot != nullptr) {
+      slot->busy = false;
+    }
+    return status;
+  }
+
+  // Requires mutex_. Counts the calling thread among the virtual time
+  // participants until it exits.
+  void RegisterVirtualThread() {
+    thread_local struct Registration {
+      Impl* impl = nullptr;
+      size_t epoch = 0;
+      ~Registration() {
+        if (impl != nullptr) {
+          std::lock_guard lock(impl->mutex_);
+          if (impl->virtual_time_ && impl->virtual_epoch_ == epoch && impl->virtual_threads_ > 0) {
+            impl->virtual_threads_--;
+            impl->AdvanceVirtualClock();
+          }
+        }
+      }
+    } registration;
+    registration.impl = this;
+    registration.epoch = virtual_epoch_;
+  }
+
+  // Requires mutex_. Once every participant is asleep or blocked in Process,
+  // jumps the clock to the earliest deadline and wakes those sleepers.
+  void AdvanceVirtualClock() {
+    if (!virtual_time_ || sleepers_.empty()) {
+      return;
+    }
+    size_t parked = sleepers_.size();
+    for (const auto& slot : waiters_) {
+      if (slot.busy && slot.ready_fn != nullptr && !slot.ready_fn(slot.ready)) {
+        parked++;
+      }
+    }
+    if (parked < virtual_threads_) {
+      return;
+    }
+    auto earliest = (*std::min_element(sleepers_.begin(), sleepers_.end(), [](const auto* lhs, const auto* rhs) {
+                      return lhs->deadline < rhs->deadline;
+                    }))->deadline;
+    virtual_now_ = std::max(virtual_now_, earliest);
+    auto awake = std::partition(sleepers_.begin(), sleepers_.end(),
+                                [&](const auto* sleeper) { return sleeper->deadline > virtual_now_; });
+    for (auto iter = awake; iter != sleepers_.end(); ++iter) {
+      (*iter)->woken = true;
+      (*iter)->cv.notify_one();
+    }
+    sleepers_.erase(awake, sleepers_.end());
+  }
+
+  // Requires mutex_.
+  void WakeSleepers() {
+    for (auto* sleeper : sleepers_) {
+      sleeper->woken = true;
+      sleeper->cv.notify_one();
+    }
+    sleepers_.clear();
+  }
+
+  // Requires mutex_. Applies the barrier, latch or semaphore registered at
+  // `point`, parking on that point's own condition variable.
+  ProcessStatus ProcessRendezvous(std::unique_lock<std::mutex>& lock, const std::string& point,
+                                  std::thread::id thread_id, const std::chrono::steady_clock::time_point* deadline,
+                                  const std::atomic<bool>* cancelled) {
+    auto release_iter = semaphore_releases_.find(point);
+    if (release_iter != semaphore_releases_.end()) {
+      auto& semaphore = rendezvous_[release_iter->second];
+      if (semaphore.arrived > 0) {
+        semaphore.arrived--;
+        semaphore.cv.notify_one();
+      }
+    }
+    auto iter = rendezvous_.find(point);
+    if (iter == rendezvous_.end()) {
+      return ProcessStatus::kReleased;
+    }
+    auto& rendezvous = iter->second;
+    switch (rendezvous.kind) {
+      case RendezvousKind::kBarrier: {
+        size_t generation = rendezvous.generation;
+        if (++rendezvous.arrived == rendezvous.count) {
+          rendezvous.arrived = 0;
+          rendezvous.generation++;
+          rendezvous.cv.notify_all();
+          return ProcessStatus::kReleased;
+        }
+        auto status = Wait(lock, rendezvous.cv, point, thread_id, &rendezvous, deadline, cancelled,
+                           [&] { return rendezvous.generation != generation; });
+        if (status != ProcessStatus::kReleased && rendezvous.generation == generation) {
+          // leave the barrier so the next thread does not complete it early
+          rendezvous.arrived--;
+        }
+        return status;
+      }
+      case RendezvousKind::kLatch:
+        if (++rendezvous.arrived == rendezvous.count) {
+          rendezvous.cv.notify_all();
+        }
+        return Wait(lock, rendezvous.cv, point, thread_id, &rendezvous, deadline, cancelled,
+                    [&] { return rendezvous.arrived >= rendezvous.count; });
+      case RendezvousKind::kSemaphore: {
+        auto status = Wait(lock, rendezvous.cv, point, thread_id, &rendezvous, deadline, cancelled,
+                           [&] { return rendezvous.arrived < rendezvous.count; });
+        if (status == ProcessStatus::kReleased) {
+          rendezvous.arrived++;
+        }
+        return status;
+      }
+    }
+    return ProcessStatus::kReleased;
+  }
+
+  // Requires mutex_.
+  uint32_t Intern(const std::string& point) {
+    auto& e = explore_;
+    auto [iter, inserted] = e.point_ids.emplace(point, static_cast<uint32_t>(e.point_names.size()));
+    if (inserted) {
+      e.point_names.push_back(point);
+    }
+    return iter->second;
+  }
+
+  void ExploreWorker(size_t index) {
+    auto& e = explore_;
+    explore_worker = index;
+    std::unique_lock lock(mutex_);
+    size_t run = 0;
+    while (true) {
+      e.worker_cvs[index].wait(lock, [&] { return e.stop || e.run != run; });
+      if (e.stop) {
+        break;
+      }
+      run = e.run;
+      Yield(lock, e.start_point, index);
+      lock.unlock();
+      (*e.body)(index);
+      lock.lock();
+      e.finished |= uint64_t(1) << index;
+      e.running = kNoThread;
+      Schedule();
+    }
+    explore_worker = kNoThread;
+  }
+
+  // Requires mutex_. Gives up the run token at `point` and parks on the
+  // worker's own condition variable until the scheduler picks it again.
+  void Yield(std::unique_lock<std::mutex>& lock, uint32_t point, size_t index) {
+    auto& e = explore_;
+    e.pending[index] = point;
+    e.waiting |= uint64_t(1) << index;
+    e.running = kNoThread;
+    Schedule();
+    e.worker_cvs[index].wait(lock, [&] { return e.running == index || e.deadlock; });
+    e.waiting &= ~(uint64_t(1) << index);
+  }
+
+  // Requires mutex_. Once every unfinished worker is parked, picks the next
+  // one to run: replaying the recorded prefix first, then preferring the
+  // last thread (no preemption) and skipping threads in the sleep set.
+  void Schedule() {
+    auto& e = explore_;
+    uint64_t all = (uint64_t(1) << e.num_threads) - 1;
+    if (e.running != kNoThread || (e.waiting | e.finished) != all) {
+      return;
+    }
+    if (e.finished == all) {
+      explore_done_cv_.notify_all();
+      return;
+    }
+    if (e.deadlock) {
+      return;
+    }
+    uint64_t enabled = 0;
+    for (size_t i = 0; i < e.num_threads; ++i) {
+      bool ready = e.pending[i] == e.start_point || PredecessorsAllCleared(e.point_names[e.pending[i]]);
+      if ((e.waiting >> i & 1) && ready) {
+        enabled |= uint64_t(1) << i;
+      }
+    }
+    if (enabled == 0) {
+      // every thread is blocked on a predecessor: release them all unscheduled
+      e.deadlock = true;
+      for (auto& cv : e.worker_cvs) {
+        cv.notify_one();
+      }
+      return;
+    }
+
+    size_t depth = e.depth++;
+    if (depth == e.trace.size()) {
+      ExploreStep step;
+      step.enabled = enabled;
+      step.previous = e.last;
+      step.preemptions = e.preemptions;
+      step.points = e.pending;
+      if (depth > 0) {
+        // threads already covered by a sibling stay asleep while the chosen
+        // transition is independent of theirs
+        const auto& parent = e.trace[depth - 1];
+        uint64_t candidates = (parent.sleep | parent.done) & ~(uint64_t(1) << parent.chosen);
+        const auto& chosen_point = e.point_names[parent.points[parent.chosen]];
+        for (size_t i = 0; i < e.num_threads; ++i) {
+          if ((candidates >> i & 1) && (enabled >> i & 1) && step.points[i] == parent.points[i] &&
+              !Dependent(e.point_names[parent.points[i]], chosen_point)) {
+            step.sleep |= uint64_t(1) << i;
+          }
+        }
+      }
+      step.chosen = NextChoice(step);
+      if (step.chosen == kNoThread) {
+        // every alternative is covered elsewhere, finish the run anyway
+        bool previous_enabled = e.last != kNoThread && (enabled >> e.last & 1);
+        step.chosen = previous_enabled ? e.last : static_cast<size_t>(__builtin_ctzll(enabled));
+        step.done = enabled;
+      }
+      step.done |= uint64_t(1) << step.chosen;
+      e.trace.push_back(std::move(step));
+    }
+    size_t chosen = e.trace[depth].chosen;
+    if (!(enabled >> chosen & 1)) {
+      // the body is not deterministic under replay, fall back to any thread
+      chosen = static_cast<size_t>(__builtin_ctzll(enabled));
+      e.trace[depth].chosen = chosen;
+    }
+    if (e.last != kNoThread && (enabled >> e.last & 1) && chosen != e.last) {
+      e.preemptions++;
+    }
+    e.last = chosen;
+    e.running = chosen;
+    e.worker_cvs[chosen].notify_one();
+  }
+
+  // Requires mutex_. The first unexplored choice of `step` within the
+  // preemption bound, or kNoThread.
+  size_t NextChoice(const ExploreStep& step) {
+    uint64_t candidates = step.enabled & ~step.sleep & ~step.done;
+    bool previous_enabled = step.previous != kNoThread && (step.enabled >> step.previous & 1);
+    if (previous_enabled && (candidates >> step.previous & 1)) {
+      return step.previous;
+    }
+    if (previous_enabled && step.preemptions >= explore_.options->preemption_bound) {
+      return kNoThread;
+    }
+    return candidates == 0 ? kNoThread : static_cast<size_t>(__builtin_ctzll(candidates));
+  }
+
+  // Requires mutex_. Moves the deepest step with an unexplored choice to
+  // that choice and drops the steps below it.
+  bool Backtrack() {
+    auto& trace = explore_.trace;
+    while (!trace.empty()) {
+      auto& step = trace.back();
+      size_t next = NextChoice(step);
+      if (next != kNoThread) {
+        step.chosen = next;
+        step.done |= uint64_t(1) << next;
+        return true;
+      }
+      trace.pop_back();
+    }
+    return false;
+  }
+
+  bool Dependent(const std::string& lhs, const std::string& rhs) {
+    const auto& dependent = explore_.options->dependent;
+    return !dependent || dependent(lhs, rhs);
+  }
+
+  // Runs `fails` with `candidate` loaded in a forked child, which exits with
+  // status 1 when the failure reproduces.
+  pid_t ForkCandidate(const std::vector<SyncPointPair>& candidate, const std::function<bool()>& fails) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      bool failed = LoadDependencyAndMarkers(candidate, {}, {}, nullptr) && fails();
+      _exit(failed ? 1 : 0);
+    }
+    return pid;
+  }
+
+  enum class CandidateResult { kPasses, kFails, kInconclusive };
+
+  // Reaps `children`, killing those still running after `timeout`; a
+  // candidate failed if its child exited with status 1 or was killed by a
+  // signal other than our own SIGKILL. It is inconclusive if it was ours,
+  // or if fork failed and the candidate never ran.
+  static std::vector<CandidateResult> WaitCandidates(const std::vector<pid_t>& children,
+                                                     std::chrono::milliseconds timeout) {
+    std::vector<CandidateResult> results(children.size(), CandidateResult::kPasses);
+    std::vector<bool> running(children.size(), false);
+    for (size_t i = 0; i < children.size(); ++i) {
+      running[i] = children[i] > 0;
+      if (!running[i]) {
+        results[i] = CandidateResult::kInconclusive;
+      }
+    }
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::find(running.begin(), running.end(), true) != running.end()) {
+      bool overdue = std::chrono::steady_clock::now() >= deadline;
+      bool reaped = false;
+      for (size_t i = 0; i < children.size(); ++i) {
+        if (!running[i]) {
+          continue;
+        }
+        if (overdue) {
+          kill(children[i], SIGKILL);
+        }
+        int status = 0;
+        if (waitpid(children[i], &status, overdue ? 0 : WNOHANG) == children[i]) {
+          running[i] = false;
+          reaped = true;
+          if (WIFSIGNALED(status)) {
+            bool killed = overdue && WTERMSIG(status) == SIGKILL;
+            results[i] = killed ? CandidateResult::kInconclusive : CandidateResult::kFails;
+          } else if (WIFEXITED(status) && WEXITSTATUS(status) == 1) {
+            results[i] = CandidateResult::kFails;
+          }
+        }
+      }
+      if (!reaped) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    }
+    return results;
+  }
+
+  // Requires mutex_. Parks the thread until the step controller releases it.
+  ProcessStatus Hold(std::unique_lock<std::mutex>& lock, const std::string& point, std::thread::id thread_id,
+                     const std::chrono::steady_clock::time_point* deadline, const std::atomic<bool>* cancelled) {
+    ParkSlot slot;
+    slot.thread_id = thread_id;
+    slot.point = &point;
+    parked_.push_back(&slot);
+    parked_cv_.notify_all();
+    auto status = Wait(lock, slot.cv, point, thread_id, nullptr, deadline, cancelled, [&] { return slot.released; });
+    if (!slot.released) {
+      parked_.erase(std::find(parked_.begin(), parked_.end(), &slot));
+    }
+    return status;
+  }
+
+  // Requires mutex_.
+  void NotifyAllWaiters() {
+    cv_.notify_all();
+    for (auto& [point, rendezvous] : rendezvous_) {
+      rendezvous.cv.notify_all();
+    }
+    for (auto* slot : parked_) {
+      slot->cv.notify_one();
+    }
+  }
+
+  WaiterSlot* AcquireWaiterSlot(const std::string& point, std::thread::id thread_id,
+                                const RendezvousState* rendezvous) {
+    size_t start = std::hash<std::thread::id>()(thread_id) % kMaxWaiters;
+    for (size_t i = 0; i < kMaxWaiters; ++i) {
+      auto& slot = waiters_[(start + i) % kMaxWaiters];
+      if (!slot.busy) {
+        slot = {true, false, false, thread_id, &point, rendezvous, std::chrono::steady_clock::now(), nullptr, nullptr};
+        return &slot;
+      }
+    }
+    // the table is full, the waiter is simply not tracked
+    return nullptr;
+  }
+
+  // Requires mutex_. Lists every tracked waiter, or only those blocked since
+  // before `overdue` if it is not nullptr.
+  std::string WaitForReport(std::chrono::steady_clock::time_point now,
+                            const std::chrono::steady_clock::time_point* overdue) {
+    std::ostringstream report;
+    for (const auto& slot : waiters_) {
+      if (!slot.busy || (overdue != nullptr && (slot.reported || slot.since > *overdue))) {
+        continue;
+      }
+      auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(now - slot.since);
+      report << "thread " << slot.thread_id << " blocked " << waited.count() << "ms at \"" << *slot.point
+             << "\", waiting for:";
+      if (slot.rendezvous != nullptr) {
+        report << (slot.rendezvous->kind == RendezvousKind::kSemaphore ? " permit, in use " : " arrivals ")
+               << slot.rendezvous->arrived << "/" << slot.rendezvous->count << "\n";
+        continue;
+      }
+      ReportPending(report, *slot.point);
+      if (const auto* match = MatchPatterns(*slot.point)) {
+        for (const auto& pattern : match->successors) {
+          ReportPending(report, pattern);
+        }
+      }
+      report << "\n";
+    }
+    return report.str();
+  }
+
+  // Requires mutex_. Lists what the successor key `point`, a point or a
+  // pattern, still waits for, as SuccessorCleared checks it.
+  void ReportPending(std::ostringstream& report, const std::string& point) {
+    auto preds_iter = predecessors_.find(point);
+    if (preds_iter != predecessors_.end()) {
+      for (const auto& pred : preds_iter->second) {
+        if (cleared_points_.count(pred) == 0) {
+          report << " \"" << pred << "\"";
+        }
+      }
+    }
+    auto groups_iter = predecessor_groups_.find(point);
+    if (groups_iter != predecessor_groups_.end()) {
+      for (const auto& group : groups_iter->second) {
+        if (!GroupCleared(group)) {
+          report << " " << group.quorum << " of {";
+          for (size_t i = 0; i < group.predecessors.size(); ++i) {
+            report << (i == 0 ? "\"" : ", \"") << group.predecessors[i] << "\"";
+          }
+          report << "}";
+        }
+      }
+    }
+  }
+
+  void WatchdogLoop(std::chrono::milliseconds deadline, WatchdogAction action) {
+    auto period = std::max(deadline / 4, std::chrono::milliseconds(1));
+    std::unique_lock watchdog_lock(watchdog_mutex_);
+    while (!watchdog_cv_.wait_for(watchdog_lock, period, [this] { return watchdog_stop_; })) {
+      std::lock_guard lock(mutex_);
+      auto now = std::chrono::steady_clock::now();
+      auto overdue = now - deadline;
+      std::string report = WaitForReport(now, &overdue);
+      if (report.empty()) {
+        continue;
+      }
+      fprintf(stderr, "SyncPoint watchdog: Process blocked longer than %lldms\n%s",
+              static_cast<long long>(deadline.count()), report.c_str());
+      if (action == WatchdogAction::kAbort) {
+        std::abort();
+      }
+      for (auto& slot : waiters_) {
+        if (slot.busy && slot.since <= overdue) {
+          slot.reported = true;
+          slot.release = action == WatchdogAction::kRelease;
+        }
+      }
+      NotifyAllWaiters();
+    }
+  }
+
+  // Interns every point and compiles each successor's requirements into
+  // readiness counters: one counting its plain predecessors, plus one per
+  // group counting down its quorum. A Kahn-style sort then releases a point
+  // once all of its counters reach zero, so the check is O(points + edges).
+  // Points never released are stuck; walking back along stuck predecessors
+  // from any of them must revisit a point, which names one cycle.
+  static bool CheckDependencyAndMarkers(const std::vector<SyncPointPair>& dependencies,
+                                        const std::vector<SyncPointPair>& markers,
+                                        const std::vector<SyncPointGroup>& groups, std::string* report) {
+    std::unordered_map<std::string, size_t> ids;
+    std::vector<const std::string*> names;
+    auto intern = [&](const std::string& point) {
+      auto [iter, inserted] = ids.emplace(point, names.size());
+      if (inserted) {
+        names.push_back(&iter->first);
+      }
+      return iter->second;
+    };
+    // counter ids below names.size() are the plain counters of each point,
+    // the rest belong to groups
+    std::vector<std::pair<size_t, size_t>> edges;  // predecessor -> counter
+    std::vector<size_t> group_owner;
+    std::vector<size_t> remaining;
+    edges.reserve(dependencies.size() + markers.size());
+    for (const auto* pairs : {&dependencies, &markers}) {
+      for (const auto& pair : *pairs) {
+        edges.emplace_back(intern(pair.predecessor), intern(pair.successor));
+      }
+    }
+    for (const auto& group : groups) {
+      if (group.quorum > group.predecessors.size()) {
+        *report = "unsatisfiable group: " + group.successor + " needs " + std::to_string(group.quorum) + " of " +
+                  std::to_string(group.predecessors.size()) + " predecessors";
+        return false;
+      }
+      group_owner.push_back(intern(group.successor));
+      remaining.push_back(group.quorum);
+      for (const auto& pred : group.predecessors) {
+        edges.emplace_back(intern(pred), group_owner.size() - 1);
+      }
+    }
+    size_t num_points = names.size();
+    size_t num_counters = num_points + group_owner.size();
+    for (size_t i = dependencies.size() + markers.size(); i < edges.size(); ++i) {
+      edges[i].second += num_points;
+    }
+    // a pattern successor stands for every point it matches, which waits
+    // for what the pattern waits for
+    PatternTrie successor_patterns;
+    std::vector<size_t> pattern_ids;
+    auto add_pattern = [&](const std::string& successor) {
+      if (IsPattern(successor) &&
+          std::find(pattern_ids.begin(), pattern_ids.end(), ids[successor]) == pattern_ids.end()) {
+        successor_patterns.Add(successor, static_cast<uint32_t>(pattern_ids.size()));
+        pattern_ids.push_back(ids[successor]);
+      }
+    };
+    for (const auto* pairs : {&dependencies, &markers}) {
+      for (const auto& pair : *pairs) {
+        add_pattern(pair.successor);
+      }
+    }
+    for (const auto& group : groups) {
+      add_pattern(group.successor);
+    }
+    if (!pattern_ids.empty()) {
+      for (size_t point = 0; point < num_points; ++point) {
+        if (IsPattern(*names[point])) {
+          continue;
+        }
+        for (uint32_t id : successor_patterns.Match(*names[point])) {
+          edges.emplace_back(pattern_ids[id], point);
+        }
+      }
+    }
+    auto owner = [&](size_t counter) { return counter < num_points ? counter : group_owner[counter - num_points]; };
+
+    // counters fed by each predecessor, and predecessors feeding each
+    // counter, both in CSR form
+    std::vector<size_t> out_offsets(num_points + 1, 0);
+    std::vector<size_t> in_offsets(num_counters + 1, 0);
+    remaining.insert(remaining.begin(), num_points, 0);
+    for (const auto& [from, to] : edges) {
+      out_offsets[from + 1]++;
+      in_offsets[to + 1]++;
+      if (to < num_points) {
+        remaining[to]++;
+      }
+    }
+    for (size_t i = 0; i < num_points; ++i) {
+      out_offsets[i + 1] += out_offsets[i];
+    }
+    for (size_t i = 0; i < num_counters; ++i) {
+      in_offsets[i + 1] += in_offsets[i];
+    }
+    std::vector<size_t> out_targets(edges.size());
+    std::vector<size_t> in_sources(edges.size());
+    {
+      std::vector<size_t> out_cursor(out_offsets.begin(), out_offsets.end() - 1);
+      std::vector<size_t> in_cursor(in_offsets.begin(), in_offsets.end() - 1);
+      for (const auto& [from, to] : edges) {
+        out_targets[out_cursor[from]++] = to;
+        in_sources[in_cursor[to]++] = from;
+      }
+    }
+
+    // number of unsatisfied counters per point
+    std::vector<size_t> pending(num_points, 0);
+    for (size_t counter = 0; counter < num_counters; ++counter) {
+      if (remaining[counter] > 0) {
+        pending[owner(counter)]++;
+      }
+    }
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < num_points; ++i) {
+      if (pending[i] == 0) {
+        ready.push_back(i);
+      }
+    }
+    std::vector<bool> sorted(num_points, false);
+    size_t num_sorted = 0;
+    while (!ready.empty()) {
+      size_t point = ready.back();
+      ready.pop_back();
+      sorted[point] = true;
+      num_sorted++;
+      for (size_t i = out_offsets[point]; i < out_offsets[point + 1]; ++i) {
+        size_t counter = out_targets[i];
+        if (remaining[counter] > 0 && --remaining[counter] == 0 && --pending[owner(counter)] == 0) {
+          ready.push_back(owner(counter));
+        }
+      }
+    }
+
+    if (num_sorted != num_points) {
+      std::vector<std::vector<size_t>> group_counters(num_points);
+      for (size_t i = 0; i < group_owner.size(); ++i) {
+        group_counters[group_owner[i]].push_back(num_points + i);
+      }
+      // every unsatisfied counter of a stuck point has a stuck predecessor
+      auto stuck_predecessor = [&](size_t point) {
+        std::vector<size_t> counters = group_counters[point];
+        counters.push_back(point);
+        for (size_t counter : counters) {
+          if (remaining[counter] == 0) {
+            continue;
+          }
+          for (size_t i = in_offsets[counter]; i < in_offsets[counter + 1]; ++i) {
+            if (!sorted[in_sources[i]]) {
+              return in_sources[i];
+            }
+          }
+        }
+        return point;
+      };
+      size_t point = 0;
+      while (sorted[point]) {
+        ++point;
+      }
+      std::vector<size_t> predecessor(num_points, num_points);
+      while (predecessor[point] == num_points) {
+        predecessor[point] = stuck_predecessor(point);
+        point = predecessor[point];
+      }
+      std::vector<size_t> cycle = {point};
+      for (size_t pred = predecessor[point]; pred != point; pred = predecessor[pred]) {
+        cycle.push_back(pred);
+      }
+      cycle.push_back(point);
+      std::reverse(cycle.begin(), cycle.end());
+      std::string message = "dependency cycle: ";
+      for (size_t i = 0; i < cycle.size(); ++i) {
+        message += (i == 0 ? "" : " -> ") + *names[cycle[i]];
+      }
+      *report = std::move(message);
+      return false;
+    }
+    return true;
+  }
 
-  void DisableProcessing() { enabled_ = false; }
+  static bool Fail(std::string* report, const std::string& error) {
+    if (report != nullptr) {
+      *report = error;
+    }
+    return false;
+  }
 
-  void LoadDependencyAndMarkers(const std::vector<SyncPointPair>& dependencies,
-                                const std::vector<SyncPointPair>& markers = {}) {
-    std::lock_guard lock(mutex_);
-    successors_.clear();
-    predecessors_.clear();
-    cleared_points_.clear();
-    markers_.clear();
-    marked_thread_id_.clear();
-    for (const auto& dependency : dependencies) {
-      successors_[dependency.predecessor].push_back(dependency.successor);
-      predecessors_[dependency.successor].push_back(dependency.predecessor);
+  // Indexes a mapped graph, registers this process and publishes the graph.
+  bool Install(std::unique_ptr<SharedGraph> graph, std::string* report) {
+    graph->header = static_cast<SharedHeader*>(graph->base);
+    graph->points = reinterpret_cast<SharedPoint*>(graph->header + 1);
+    graph->edges = reinterpret_cast<const uint32_t*>(graph->points + graph->header->num_points);
+    for (uint32_t i = 0; i < graph->header->num_points; ++i) {
+      graph->index.emplace(graph->points[i].name, i);
     }
-    for (const auto& marker : markers) {
-      successors_[marker.predecessor].push_back(marker.successor);
-      predecessors_[marker.successor].push_back(marker.predecessor);
-      markers_[marker.predecessor].push_back(marker.successor);
+    if (!Register(*graph)) {
+      return Fail(report, "too many processes attached to shared graph " + graph->name);
     }
-    cv_.notify_all();
+    // a forked child counts as alive from the start, not from its first
+    // shared point, so waiters on its points do not give up early
+    static std::once_flag at_fork;
+    std::call_once(at_fork, [] {
+      pthread_atfork(nullptr, nullptr, [] {
+        if (auto* shared = GetInstance()->impl_->shared_.load(std::memory_order_acquire)) {
+          Register(*shared);
+        }
+      });
+    });
+    std::lock_guard lock(mutex_);
+    shared_.store(graph.get(), std::memory_order_release);
+    shared_graphs_.push_back(std::move(graph));
+    return true;
   }
 
-  void SetCallBack(const std::string& point, const std::function<void(const std::vector<void*>&)>& callback) {
-    std::lock_guard lock(mutex_);
-    callbacks_[point] = callback;
+  // Claims a pid slot for the calling process, reusing slots of processes
+  // that exited without detaching. Idempotent, and cheap once registered.
+  static bool Register(SharedGraph& graph) {
+    int32_t self = getpid();
+    if (graph.registered.load(std::memory_order_relaxed) == self) {
+      return true;
+    }
+    for (auto& process : graph.header->processes) {
+      int32_t pid = process.load(std::memory_order_relaxed);
+      if ((pid == 0 || pid == self || !ProcessAlive(pid)) && process.compare_exchange_strong(pid, self)) {
+        graph.registered.store(self, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
   }
 
-  void ClearCallBack(const std::string& point) {
-    std::unique_lock lock(mutex_);
-    while (num_callbacks_running_ > 0) {
-      cv_.wait(lock);
+  static bool OtherProcessAlive(const SharedHeader& header) {
+    int32_t self = getpid();
+    for (const auto& process : header.processes) {
+      int32_t pid = process.load(std::memory_order_relaxed);
+      if (pid != 0 && pid != self && ProcessAlive(pid)) {
+        return true;
+      }
     }
-    callbacks_.erase(point);
+    return false;
   }
 
-  void ClearAllCallBacks() {
-    std::unique_lock lock(mutex_);
-    while (num_callbacks_running_ > 0) {
-      cv_.wait(lock);
+  // A leftover segment may be reclaimed once none of its processes is alive.
+  static bool SharedSegmentInUse(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+      return false;
     }
-    callbacks_.clear();
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(SharedHeader)) {
+      base = mmap(nullptr, sizeof(SharedHeader), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED) {
+      return false;
+    }
+    bool in_use = false;
+    for (const auto& process : static_cast<const SharedHeader*>(base)->processes) {
+      int32_t pid = process.load(std::memory_order_relaxed);
+      in_use |= pid != 0 && pid != getpid() && ProcessAlive(pid);
+    }
+    munmap(base, sizeof(SharedHeader));
+    return in_use;
   }
 
-  void ClearTrace() {
-    std::lock_guard lock(mutex_);
-    cleared_points_.clear();
+  // Waits on the futex word of each predecessor in turn, then clears the
+  // point and wakes its waiters in every process. Besides a deadline or
+  // cancellation, a waiter gives up once no other attached process is left
+  // alive to clear its predecessor.
+  bool SharedPredecessorsCleared(const SharedGraph& shared, uint32_t id) {
+    const auto& point = shared.points[id];
+    for (uint32_t i = 0; i < point.num_predecessors; ++i) {
+      if (shared.points[shared.edges[point.first_predecessor + i]].cleared.load(std::memory_order_acquire) == 0) {
+        return false;
+      }
+    }
+    return true;
   }
 
-  void Process(const std::string& point, const std::vector<void*>& cb_args) {
-    if (!enabled_) {
-      return;
+  ProcessStatus ProcessShared(SharedGraph& shared, uint32_t id, const std::vector<void*>& cb_args,
+                              const std::chrono::steady_clock::time_point* deadline, const std::atomic<bool>* cancelled,
+                              Action* action) {
+    auto& point = shared.points[id];
+    // also a process that only clears points must count as alive
+    Register(shared);
+    for (uint32_t i = 0; i < point.num_predecessors; ++i) {
+      auto& pred = shared.points[shared.edges[point.first_predecessor + i]];
+      if (pred.cleared.load(std::memory_order_acquire) != 0) {
+        continue;
+      }
+      while (pred.cleared.load(std::memory_order_acquire) == 0) {
+        if (cancelled != nullptr && *cancelled) {
+          return ProcessStatus::kCancelled;
+        }
+        std::chrono::nanoseconds slice = kSharedLivenessInterval;
+        if (deadline != nullptr) {
+          auto left = *deadline - std::chrono::steady_clock::now();
+          if (left <= left.zero()) {
+            return ProcessStatus::kTimedOut;
+          }
+          slice = std::min<std::chrono::nanoseconds>(slice, left);
+        }
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(slice);
+        timespec timeout{static_cast<time_t>(seconds.count()), static_cast<long>((slice - seconds).count())};
+        pred.waiters.fetch_add(1, std::memory_order_seq_cst);
+        long ret = Futex(&pred.cleared, FUTEX_WAIT, 0, &timeout);
+        pred.waiters.fetch_sub(1, std::memory_order_relaxed);
+        if (ret != 0 && errno == ETIMEDOUT && pred.cleared.load(std::memory_order_acquire) == 0 &&
+            !OtherProcessAlive(*shared.header)) {
+          fprintf(stderr, "SyncPoint: no live process left to clear \"%s\" before \"%s\"\n", pred.name, point.name);
+          return ProcessStatus::kTimedOut;
+        }
+      }
     }
     std::unique_lock lock(mutex_);
-    auto thread_id = std::this_thread::get_id();
-    auto marker_iter = markers_.find(point);
-    if (marker_iter != markers_.end()) {
-      for (auto& marked_point : marker_iter->second) {
-        marked_thread_id_.emplace(marked_point, thread_id);
-      }
+    auto chain_action = RunCallBack(lock, point.name, cb_args);
+    if (action != nullptr) {
+      *action = chain_action;
     }
+    point.cleared.store(1, std::memory_order_seq_cst);
+    if (point.waiters.load(std::memory_order_seq_cst) != 0) {
+      Futex(&point.cleared, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+    // local and async successors of a shared point wait on the local graph
+    cleared_points_.insert(point.name);
+    cv_.notify_all();
+    if (!async_waiters_.empty()) {
+      DispatchAsync(lock, point.name);
+    }
+    return ProcessStatus::kReleased;
+  }
 
-    if (DisabledByMarker(point, thread_id)) {
+  // Requires mutex_. Collects the patterns among the callback and
+  // successor keys, rebuilds the trie and re-resolves every point seen.
+  void CompilePatterns() {
+    std::vector<std::string> patterns;
+    for (const auto& [point, callback] : callbacks_) {
+      if (IsPattern(point)) {
+        patterns.push_back(point);
+      }
+    }
+    for (const auto& [point, preds] : predecessors_) {
+      if (IsPattern(point)) {
+        patterns.push_back(point);
+      }
+    }
+    for (const auto& [point, groups] : predecessor_groups_) {
+      if (IsPattern(point)) {
+        patterns.push_back(point);
+      }
+    }
+    std::sort(patterns.begin(), patterns.end());
+    patterns.erase(std::unique(patterns.begin(), patterns.end()), patterns.end());
+    if (patterns.empty() && patterns_.empty()) {
       return;
     }
+    patterns_ = std::move(patterns);
+    pattern_trie_ = PatternTrie();
+    for (size_t i = 0; i < patterns_.size(); ++i) {
+      pattern_trie_.Add(patterns_[i], static_cast<uint32_t>(i));
+    }
+    for (auto& [point, match] : pattern_matches_) {
+      match = ResolvePatterns(point);
+    }
+  }
 
-    while (!PredecessorsAllCleared(point)) {
-      cv_.wait(lock);
-      if (DisabledByMarker(point, thread_id)) {
-        return;
+  // Requires mutex_. The most specific callback pattern, the one with the
+  // most literal characters, wins.
+  PatternMatch ResolvePatterns(const std::string& point) {
+    PatternMatch match;
+    size_t best_literals = 0;
+    for (uint32_t id : pattern_trie_.Match(point)) {
+      const auto& pattern = patterns_[id];
+      if (callbacks_.count(pattern) > 0) {
+        size_t literals = LiteralCount(pattern);
+        if (match.callback.empty() || literals > best_literals) {
+          match.callback = pattern;
+          best_literals = literals;
+        }
+      }
+      if (predecessors_.count(pattern) > 0 || predecessor_groups_.count(pattern) > 0) {
+        match.successors.push_back(pattern);
       }
     }
+    return match;
+  }
+
+  // Requires mutex_. nullptr while there are no patterns.
+  const PatternMatch* MatchPatterns(const std::string& point) {
+    if (patterns_.empty() || IsPattern(point)) {
+      return nullptr;
+    }
+    auto iter = pattern_matches_.find(point);
+    if (iter == pattern_matches_.end()) {
+      iter = pattern_matches_.emplace(point, ResolvePatterns(point)).first;
+    }
+    return &iter->second;
+  }
 
-    const auto& callback_pair = callbacks_.find(point);
+  // Requires mutex_, held through `lock`; released while the callbacks run.
+  // Returns the action ending the chain, kSkip as kContinue.
+  Action RunCallBack(std::unique_lock<std::mutex>& lock, const std::string& point, const std::vector<void*>& cb_args) {
+    auto action = Action::kContinue;
+    auto callback_pair = callbacks_.find(point);
+    if (callback_pair == callbacks_.end()) {
+      const auto* match = MatchPatterns(point);
+      if (match != nullptr && !match->callback.empty()) {
+        callback_pair = callbacks_.find(match->callback);
+      }
+    }
+    if (callback_pair != callbacks_.end() && !filter_config_.empty()) {
+      auto filter = filter_config_.find(callback_pair->first);
+      if (filter != filter_config_.end() && !filter->second.Matches(cb_args)) {
+        return action;
+      }
+    }
     if (callback_pair != callbacks_.end()) {
+      auto chain = callback_pair->second;
       num_callbacks_running_++;
-      mutex_.unlock();
-      callback_pair->second(cb_args);
-      mutex_.lock();
+      lock.unlock();
+      for (const auto& entry : chain->entries) {
+        action = entry.callback(cb_args);
+        if (action != Action::kContinue) {
+          break;
+        }
+      }
+      lock.lock();
       num_callbacks_running_--;
     }
-    cleared_points_.insert(point);
-    cv_.notify_all();
+    return action == Action::kSkip ? Action::kContinue : action;
+  }
+
+  // Requires mutex_. Publishes a copy of the chain of `point` with
+  // `callback` after every entry of at least its priority.
+  CallbackHandle AddEntry(const std::string& point, ChainedCallback callback, int priority) {
+    auto [iter, inserted] = callbacks_.try_emplace(point);
+    auto chain = std::make_shared<CallbackChain>();
+    if (!inserted) {
+      chain->entries.reserve(iter->second->entries.size() + 1);
+      chain->entries = iter->second->entries;
+    }
+    auto handle = ++next_callback_handle_;
+    auto pos = std::find_if(chain->entries.begin(), chain->entries.end(),
+                            [priority](const auto& entry) { return entry.priority < priority; });
+    chain->entries.insert(pos, {priority, handle, std::move(callback)});
+    iter->second = std::move(chain);
+    callback_points_.emplace(handle, point);
+    if (inserted) {
+      if (IsPattern(point)) {
+        CompilePatterns();
+      }
+      PublishFilters();
+    }
+    return handle;
+  }
+
+  // Requires mutex_. Publishes a copy of the chain without `handle`, and
+  // drops the point once its chain is empty.
+  bool RemoveEntry(CallbackHandle handle) {
+    auto point_iter = callback_points_.find(handle);
+    if (point_iter == callback_points_.end()) {
+      return false;
+    }
+    auto point = std::move(point_iter->second);
+    callback_points_.erase(point_iter);
+    auto iter = callbacks_.find(point);
+    auto chain = std::make_shared<CallbackChain>();
+    for (const auto& entry : iter->second->entries) {
+      if (entry.handle != handle) {
+        chain->entries.push_back(entry);
+      }
+    }
+    if (!chain->entries.empty()) {
+      iter->second = std::move(chain);
+    } else {
+      callbacks_.erase(iter);
+      if (IsPattern(point)) {
+        CompilePatterns();
+      }
+      PublishFilters();
+    }
+    return true;
+  }
+
+  // Requires mutex_, held through `lock`. Processes the awaiters whose last
+  // outstanding predecessor was `point`, then those they release in turn.
+  // Callbacks and continuations run with the lock released.
+  void DispatchAsync(std::unique_lock<std::mutex>& lock, const std::string& point) {
+    std::vector<std::string> cleared{point};
+    while (!cleared.empty()) {
+      auto successors_iter = successors_.find(cleared.back());
+      cleared.pop_back();
+      if (successors_iter == successors_.end()) {
+        continue;
+      }
+      std::vector<std::pair<std::string, AsyncWaiter>> ready;
+      for (const auto& successor : successors_iter->second) {
+        auto waiters_iter = async_waiters_.find(successor);
+        if (waiters_iter == async_waiters_.end() || !PredecessorsAllCleared(successor)) {
+          continue;
+        }
+        for (auto& waiter : waiters_iter->second) {
+          ready.emplace_back(successor, std::move(waiter));
+        }
+        async_waiters_.erase(waiters_iter);
+      }
+      for (auto& [successor, waiter] : ready) {
+        auto marked_point_iter = marked_context_.find(successor);
+        bool disabled = marked_point_iter != marked_context_.end() && waiter.context != marked_point_iter->second;
+        auto action = Action::kContinue;
+        if (!disabled) {
+          action = RunCallBack(lock, successor, {});
+          cleared_points_.insert(successor);
+          cv_.notify_all();
+          cleared.push_back(successor);
+        }
+        lock.unlock();
+        waiter.resume(ProcessStatus::kReleased, action);
+        lock.lock();
+      }
+    }
+  }
+
+  // Requires mutex_, held through `lock`. Resumes every suspended awaiter
+  // with kCancelled, leaving its point unprocessed, as the graph it waited
+  // on is gone. Continuations run with the lock released.
+  void CancelAsync(std::unique_lock<std::mutex>& lock) {
+    if (async_waiters_.empty()) {
+      return;
+    }
+    auto waiters = std::move(async_waiters_);
+    async_waiters_.clear();
+    lock.unlock();
+    for (auto& [point, point_waiters] : waiters) {
+      for (auto& waiter : point_waiters) {
+        waiter.resume(ProcessStatus::kCancelled, Action::kContinue);
+      }
+    }
+    lock.lock();
   }
 
- private:
   bool PredecessorsAllCleared(const std::string& point) {
-    for (const auto& pred : predecessors_[point]) {
-      if (cleared_points_.count(pred) == 0) {
-        return false;
+    if (!SuccessorCleared(point)) {
+      return false;
+    }
+    const auto* match = MatchPatterns(point);
+    if (match != nullptr) {
+      for (const auto& pattern : match->successors) {
+        if (!SuccessorCleared(pattern)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // whether the predecessors registered under the successor key `point`,
+  // a point or a pattern, are cleared
+  bool SuccessorCleared(const std::string& point) {
+    auto preds_iter = predecessors_.find(point);
+    if (preds_iter != predecessors_.end()) {
+      for (const auto& pred : preds_iter->second) {
+        if (cleared_points_.count(pred) == 0) {
+          return false;
+        }
+      }
+    }
+    auto groups_iter = predecessor_groups_.find(point);
+    if (groups_iter != predecessor_groups_.end()) {
+      for (const auto& group : groups_iter->second) {
+        if (!GroupCleared(group)) {
+          return false;
+        }
       }
     }
     return true;
   }
 
-  bool DisabledByMarker(const std::string& point, std::thread::id thread_id) {
-    auto marked_point_iter = marked_thread_id_.find(point);
-    return marked_point_iter != marked_thread_id_.end() && thread_id != marked_point_iter->second;
+  bool GroupCleared(const SyncPointGroup& group) {
+    size_t cleared = 0;
+    for (const auto& pred : group.predecessors) {
+      if (cleared >= group.quorum) {
+        break;
+      }
+      cleared += cleared_points_.count(pred);
+    }
+    return cleared >= group.quorum;
+  }
+
+  ExecutionContext CurrentContext() {
+    auto provider = context_provider_.load(std::memory_order_acquire);
+    uint64_t task = provider != nullptr ? provider() : 0;
+    if (task != 0) {
+      return {std::thread::id(), task};
+    }
+    return {std::this_thread::get_id(), 0};
+  }
+
+  bool DisabledByMarker(const std::string& point) {
+    auto marked_point_iter = marked_context_.find(point);
+    return marked_point_iter != marked_context_.end() && CurrentContext() != marked_point_iter->second;
   }
 };
 
@@ -147,23 +2968,397 @@ void SyncPoint::EnableProcessing() { impl_->EnableProcessing(); }
 
 void SyncPoint::DisableProcessing() { impl_->DisableProcessing(); }
 
-void SyncPoint::LoadDependencyAndMarkers(const std::vector<SyncPointPair>& dependencies,
-                                         const std::vector<SyncPointPair>& markers) {
-  impl_->LoadDependencyAndMarkers(dependencies, markers);
+bool SyncPoint::LoadDependencyAndMarkers(const std::vector<SyncPointPair>& dependencies,
+                                         const std::vector<SyncPointPair>& markers, std::string* report) {
+  return impl_->LoadDependencyAndMarkers(dependencies, markers, {}, report);
+}
+
+bool SyncPoint::LoadDependencyAndMarkers(const std::vector<SyncPointPair>& dependencies,
+                                         const std::vector<SyncPointPair>& markers,
+                                         const std::vector<SyncPointGroup>& groups, std::string* report) {
+  return impl_->LoadDependencyAndMarkers(dependencies, markers, groups, report);
+}
+
+bool SyncPoint::ParseDependencies(const std::string& spec, std::vector<SyncPointPair>* dependencies,
+                                  std::vector<SyncPointPair>* markers, std::string* report) {
+  return SpecParser(spec).Parse(dependencies, markers, report);
+}
+
+std::string SyncPoint::FormatDependencies(const std::vector<SyncPointPair>& dependencies,
+                                          const std::vector<SyncPointPair>& markers) {
+  // the keyword, and a '{' that would start a JSON spec, are quoted too
+  auto quote = [](const std::string& name) {
+    bool plain = !name.empty() && name != "marker" && name[0] != '{' &&
+                 name.find_first_of(" \t\r\n;#\"\\") == std::string::npos && name.find("->") == std::string::npos &&
+                 name.find("=>") == std::string::npos;
+    if (plain) {
+      return name;
+    }
+    std::string quoted = "\"";
+    for (char c : name) {
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+        quoted += c;
+      } else if (c == '\n') {
+        quoted += "\\n";
+      } else if (c == '\t') {
+        quoted += "\\t";
+      } else if (c == '\r') {
+        quoted += "\\r";
+      } else {
+        quoted += c;
+      }
+    }
+    return quoted + "\"";
+  };
+  std::string spec;
+  for (const auto& dependency : dependencies) {
+    spec += quote(dependency.predecessor) + " -> " + quote(dependency.successor) + "\n";
+  }
+  for (const auto& marker : markers) {
+    spec += "marker " + quote(marker.predecessor) + " => " + quote(marker.successor) + "\n";
+  }
+  return spec;
+}
+
+bool SyncPoint::LoadDependencySpec(const std::string& spec, std::string* report) {
+  std::vector<SyncPointPair> dependencies;
+  std::vector<SyncPointPair> markers;
+  return ParseDependencies(spec, &dependencies, &markers, report) &&
+         LoadDependencyAndMarkers(dependencies, markers, report);
+}
+
+bool SyncPoint::LoadDependencyFile(const std::string& path, std::string* report) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    if (report != nullptr) {
+      *report = "cannot open " + path;
+    }
+    return false;
+  }
+  std::string spec((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  std::string error;
+  if (!LoadDependencySpec(spec, &error)) {
+    if (report != nullptr) {
+      *report = path + ": " + error;
+    }
+    return false;
+  }
+  return true;
+}
+
+bool SyncPoint::LoadDependencyFromEnv(const std::string& name, std::string* report) {
+  const char* value = getenv(name.c_str());
+  if (value == nullptr) {
+    if (report != nullptr) {
+      *report = name + " is not set";
+    }
+    return false;
+  }
+  return value[0] == '@' ? LoadDependencyFile(value + 1, report) : LoadDependencySpec(value, report);
+}
+
+void SyncPoint::SetPointEnabled(const std::string& pattern, bool enabled) {
+  impl_->SetPointEnabled(pattern, enabled);
+}
+
+void SyncPoint::EnableChaos(uint64_t seed, const ChaosOptions& options) { impl_->EnableChaos(seed, options); }
+
+void SyncPoint::SetChaos(const std::string& pattern, const ChaosOptions& options) {
+  impl_->SetChaos(pattern, options);
+}
+
+void SyncPoint::DisableChaos() { impl_->DisableChaos(); }
+
+void SyncPoint::SetContextProvider(ContextProvider provider) { impl_->SetContextProvider(provider); }
+
+void SyncPoint::SetChainedCallBack(const std::string& point, const CallbackFilter* filter,
+                                   ChainedCallback callback) {
+  impl_->SetCallBack(point, filter, std::move(callback));
+}
+
+bool SyncPoint::CallbackFilter::Matches(const std::vector<void*>& cb_args) const {
+  for (const auto& clause : args) {
+    if (clause.index >= cb_args.size() || cb_args[clause.index] == nullptr ||
+        memcmp(cb_args[clause.index], &clause.bits, clause.size) != 0) {
+      return false;
+    }
+  }
+  return threads.empty() || std::find(threads.begin(), threads.end(), std::this_thread::get_id()) != threads.end();
+}
+
+SyncPoint::CallbackHandle SyncPoint::AddChainedCallBack(const std::string& point, ChainedCallback callback,
+                                                        int priority) {
+  return impl_->AddCallBack(point, std::move(callback), priority);
+}
+
+bool SyncPoint::RemoveCallBack(CallbackHandle handle) { return impl_->RemoveCallBack(handle); }
+
+std::function<void(const std::vector<void*>&)> SyncPoint::MigrateThreadAction() {
+  return [](const std::vector<void*>&) {
+    cpu_set_t allowed;
+    int current = sched_getcpu();
+    if (current < 0 || sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) < 2) {
+      return;
+    }
+    cpu_set_t target;
+    CPU_ZERO(&target);
+    for (int i = 1; i < CPU_SETSIZE; ++i) {
+      int cpu = (current + i) % CPU_SETSIZE;
+      if (CPU_ISSET(cpu, &allowed)) {
+        CPU_SET(cpu, &target);
+        break;
+      }
+    }
+    // the thread runs on the target CPU once pinned there, after which the
+    // original affinity is restored so that it is not pinned for good
+    if (sched_setaffinity(0, sizeof(target), &target) == 0) {
+      sched_setaffinity(0, sizeof(allowed), &allowed);
+    }
+  };
 }
 
-void SyncPoint::SetCallBack(const std::string& point, const std::function<void(const std::vector<void*>&)>& callback) {
-  impl_->SetCallBack(point, callback);
+std::function<void(const std::vector<void*>&)> SyncPoint::LowerPriorityAction(int nice_increment) {
+  return [nice_increment](const std::vector<void*>&) {
+    auto tid = static_cast<id_t>(syscall(SYS_gettid));
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, tid);
+    if (nice == -1 && errno != 0) {
+      return;
+    }
+    setpriority(PRIO_PROCESS, tid, std::min(nice + nice_increment, 19));
+  };
+}
+
+std::function<void(const std::vector<void*>&)> SyncPoint::ContextSwitchAction() {
+  return [](const std::vector<void*>&) {
+    // sched_yield returns at once when no other thread is runnable on the
+    // CPU, a sleep always gives it up
+    std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+  };
+}
+
+SyncPoint::CallbackHandle SyncPoint::SetFault(const std::string& point, const FaultSpec& spec) {
+  return impl_->SetFault(point, spec);
+}
+
+SyncPoint::FaultStats SyncPoint::GetFaultStats(const std::string& point) { return impl_->GetFaultStats(point); }
+
+std::pair<SyncPoint::CallbackHandle, SyncPoint::CallbackHandle> SyncPoint::FailAllocationBetween(
+    const std::string& begin_point, const std::string& end_point, uint64_t nth, std::thread::id thread) {
+  auto begin = AddCallBack(begin_point, [nth, thread](const std::vector<void*>&) {
+    if (thread == std::thread::id() || thread == std::this_thread::get_id()) {
+      paused_alloc_countdown = nth;
+    }
+  });
+  auto end = AddCallBack(end_point, [](const std::vector<void*>&) { paused_alloc_countdown = 0; });
+  return {begin, end};
 }
 
 void SyncPoint::ClearCallBack(const std::string& point) { impl_->ClearCallBack(point); }
 
 void SyncPoint::ClearAllCallBacks() { impl_->ClearAllCallBacks(); }
 
+void SyncPoint::SetBarrier(const std::string& point, size_t count) {
+  impl_->SetRendezvous(point, RendezvousKind::kBarrier, count);
+}
+
+void SyncPoint::SetLatch(const std::string& point, size_t count) {
+  impl_->SetRendezvous(point, RendezvousKind::kLatch, count);
+}
+
+void SyncPoint::SetSemaphore(const std::string& acquire_point, const std::string& release_point, size_t permits) {
+  impl_->SetRendezvous(acquire_point, RendezvousKind::kSemaphore, permits, release_point);
+}
+
+void SyncPoint::ClearRendezvous() { impl_->ClearRendezvous(); }
+
+SyncPoint::ExploreResult SyncPoint::Explore(size_t num_threads, const std::function<void()>& setup,
+                                            const std::function<void(size_t)>& body,
+                                            const std::function<bool()>& check, const ExploreOptions& options) {
+  return impl_->Explore(num_threads, setup, body, check, options);
+}
+
+SyncPoint::ExploreResult SyncPoint::Explore(size_t num_threads, const std::function<void()>& setup,
+                                            const std::function<void(size_t)>& body,
+                                            const std::function<bool()>& check) {
+  return impl_->Explore(num_threads, setup, body, check, ExploreOptions());
+}
+
+std::vector<SyncPoint::SyncPointPair> SyncPoint::MinimizeDependencies(
+    const std::vector<SyncPointPair>& dependencies, const std::function<bool()>& fails, size_t jobs,
+    std::chrono::milliseconds timeout) {
+  return impl_->MinimizeDependencies(dependencies, fails, jobs, timeout);
+}
+
+bool SyncPoint::ScheduleToDependencies(const std::vector<ScheduleStep>& schedule,
+                                       std::vector<SyncPointPair>* dependencies, std::string* report) {
+  auto fail = [&](const std::string& error) {
+    if (report != nullptr) {
+      *report = error;
+    }
+    return false;
+  };
+  dependencies->clear();
+  // every hit is a step of its own, so a name seen twice is hit twice
+  std::unordered_map<std::string, size_t> reached_by;
+  for (const auto& step : schedule) {
+    if (step.point.empty()) {
+      continue;
+    }
+    auto [iter, inserted] = reached_by.emplace(step.point, step.thread);
+    if (!inserted) {
+      return fail("\"" + step.point + "\" is reached more than once (threads " + std::to_string(iter->second) +
+                  " and " + std::to_string(step.thread) + ")");
+    }
+  }
+
+  std::unordered_set<std::string> seen;
+  // the step of the last point passed
+  const ScheduleStep* last = nullptr;
+  for (size_t i = 0; i < schedule.size(); ++i) {
+    const auto& step = schedule[i];
+    if (last != nullptr && last->thread != step.thread && (i == 0 || schedule[i - 1].thread != step.thread)) {
+      const ScheduleStep* target = &step;
+      for (size_t j = i + 1; target->point.empty() && j < schedule.size(); ++j) {
+        if (schedule[j].thread == step.thread) {
+          target = &schedule[j];
+        }
+      }
+      if (target->point.empty()) {
+        return fail("thread " + std::to_string(step.thread) + " runs after thread " + std::to_string(last->thread) +
+                    " but never reaches a sync point");
+      }
+      if (seen.insert(last->point + '\0' + target->point).second) {
+        dependencies->push_back({last->point, target->point});
+      }
+    }
+    if (!step.point.empty()) {
+      last = &step;
+    }
+  }
+  return true;
+}
+
+void SyncPoint::HoldAt(const std::vector<std::string>& points) { impl_->HoldAt(points); }
+
+void SyncPoint::ClearHolds() { impl_->ClearHolds(); }
+
+std::vector<SyncPoint::ParkedThread> SyncPoint::ParkedThreads() { return impl_->ParkedThreads(); }
+
+bool SyncPoint::WaitForParked(size_t count, std::chrono::steady_clock::duration timeout) {
+  return impl_->WaitForParked(count, timeout);
+}
+
+bool SyncPoint::Step(std::thread::id thread_id) { return impl_->Step(thread_id); }
+
+void SyncPoint::EnableWatchdog(std::chrono::milliseconds deadline, WatchdogAction action) {
+  impl_->EnableWatchdog(deadline, action);
+}
+
+void SyncPoint::DisableWatchdog() { impl_->DisableWatchdog(); }
+
+std::string SyncPoint::DumpWaiters() { return impl_->DumpWaiters(); }
+
+void SyncPoint::EnableVirtualTime(size_t num_threads) { impl_->EnableVirtualTime(num_threads); }
+
+void SyncPoint::DisableVirtualTime() { impl_->DisableVirtualTime(); }
+
+std::chrono::nanoseconds SyncPoint::VirtualNow() { return impl_->VirtualNow(); }
+
+void SyncPoint::SleepFor(const std::string& point, std::chrono::nanoseconds duration) {
+  impl_->SleepFor(point, duration);
+}
+
 void SyncPoint::ClearTrace() { impl_->ClearTrace(); }
 
-void SyncPoint::Process(const std::string& point, const std::vector<void*>& cb_args) { impl_->Process(point, cb_args); }
+SyncPoint::Action SyncPoint::Process(const std::string& point, const std::vector<void*>& cb_args) {
+  auto action = Action::kContinue;
+  impl_->Process(point, cb_args, nullptr, nullptr, &action);
+  return action;
+}
+
+bool SyncPoint::TakeAction(Action action, const std::string& point) {
+  switch (action) {
+    case Action::kReturn:
+      return true;
+    case Action::kThrow:
+      throw InjectedFault("fault injected at " + point);
+    case Action::kAbort:
+      fprintf(stderr, "SyncPoint: abort injected at \"%s\"\n", point.c_str());
+      abort();
+    default:
+      return false;
+  }
+}
+
+SyncPoint::ProcessStatus SyncPoint::ProcessFor(const std::string& point, std::chrono::steady_clock::duration timeout,
+                                               const std::vector<void*>& cb_args) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  return impl_->Process(point, cb_args, &deadline, nullptr, nullptr);
+}
+
+SyncPoint::ProcessStatus SyncPoint::ProcessUntil(const std::string& point,
+                                                 std::chrono::steady_clock::time_point deadline,
+                                                 const std::vector<void*>& cb_args,
+                                                 const std::atomic<bool>* cancelled) {
+  return impl_->Process(point, cb_args, &deadline, cancelled, nullptr);
+}
+
+void SyncPoint::WakeWaiters() { impl_->WakeWaiters(); }
+
+bool SyncPoint::ProcessOrSuspend(const std::string& point, std::function<void(ProcessStatus, Action)> resume) {
+  return impl_->ProcessOrSuspend(point, std::move(resume));
+}
+
+bool SyncPoint::TryProcess(const std::string& point) { return impl_->ProcessOrSuspend(point, nullptr); }
+
+void SyncPoint::ProcessAsync(const std::string& point, std::function<void()> on_ready) {
+  impl_->ProcessAsync(point, std::move(on_ready));
+}
+
+bool SyncPoint::CreateSharedGraph(const std::string& name, const std::vector<SyncPointPair>& dependencies,
+                                  std::string* report) {
+  return impl_->CreateSharedGraph(name, dependencies, report);
+}
+
+bool SyncPoint::AttachSharedGraph(const std::string& name, std::string* report) {
+  return impl_->AttachSharedGraph(name, report);
+}
+
+void SyncPoint::DetachSharedGraph() { impl_->DetachSharedGraph(); }
+
+void SyncPoint::SetRemote(Remote* remote) { impl_->SetRemote(remote); }
+
+int SyncPoint::CompletionFd() { return impl_->CompletionFd(); }
+
+size_t SyncPoint::RunCompletions() { return impl_->RunCompletions(); }
 
 }  // namespace utils
 
+#ifdef SYNC_POINT_ALLOCATION_HOOK
+// Replaces the global allocation function for FailAllocationBetween. The
+// array and nothrow forms call this one, and the default operator delete
+// frees memory from malloc. Aligned allocations are not hooked.
+void* operator new(std::size_t size) {
+  if (utils::alloc_countdown != 0 && --utils::alloc_countdown == 0) {
+    throw std::bad_alloc();
+  }
+  if (size == 0) {
+    size = 1;
+  }
+  while (true) {
+    void* ptr = std::malloc(size);
+    if (ptr != nullptr) {
+      return ptr;
+    }
+    auto handler = std::get_new_handler();
+    if (handler == nullptr) {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+#endif  // SYNC_POINT_ALLOCATION_HOOK
+
 #endif  // UNIT_TEST
@@ -2,12 +2,23 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#if __cplusplus >= 202002L
+#include <coroutine>
+#include <stop_token>
+#endif
 #include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #ifdef UNIT_TEST
@@ -27,10 +38,186 @@ class SyncPoint {
     std::string successor;
   };
 
+  // `successor` may proceed once `quorum` of `predecessors` have been
+  // processed: a quorum of 1 is an any-of (OR) dependency.
+  struct SyncPointGroup {
+    std::vector<std::string> predecessors;
+    std::string successor;
+    size_t quorum = 1;
+  };
+
+  // How Process perturbs the calling thread in chaos mode: with each
+  // probability it yields, busy-waits up to `max_spin` or sleeps up to
+  // `max_sleep`, uniformly; otherwise it does nothing.
+  struct ChaosOptions {
+    double yield_probability = 0;
+    double spin_probability = 0;
+    double sleep_probability = 0;
+    std::chrono::nanoseconds max_spin = std::chrono::microseconds(10);
+    std::chrono::nanoseconds max_sleep = std::chrono::milliseconds(1);
+  };
+
+  // What a callback tells its site to do. The site macros act on it;
+  // TEST_SYNC_POINT and TEST_SYNC_POINT_ARGS only continue.
+  enum class Action : uint8_t {
+    kContinue,  // run the next callback, then the rest of the site
+    kSkip,      // skip the remaining callbacks, then run the rest of the site
+    kReturn,    // return from the site; TEST_SYNC_POINT_RETURN_VALUE returns
+                // the value the callback wrote through args[0]
+    kThrow,     // throw InjectedFault from the site
+    kAbort,     // abort the process at the site
+  };
+
+  class InjectedFault : public std::runtime_error {
+   public:
+    using std::runtime_error::runtime_error;
+  };
+
+  // A declarative condition on the hits of a point, for SetCallBack. Every
+  // clause must hold, e.g. CallbackFilter().ArgEqual(0, shard).
+  struct CallbackFilter {
+    struct ArgEquals {
+      size_t index;
+      size_t size;
+      uint64_t bits;
+    };
+    std::vector<ArgEquals> args;
+    // any thread if empty
+    std::vector<std::thread::id> threads;
+
+    // `*static_cast<T*>(args[index]) == value`, compared bitwise, so T is an
+    // integer, an enum or a pointer
+    template <typename T>
+    CallbackFilter& ArgEqual(size_t index, T value) {
+      static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= sizeof(uint64_t), "T must fit in 64 bits");
+      ArgEquals clause{index, sizeof(T), 0};
+      std::memcpy(&clause.bits, &value, sizeof(T));
+      args.push_back(clause);
+      return *this;
+    }
+
+    CallbackFilter& OnThreads(std::vector<std::thread::id> ids) {
+      threads = std::move(ids);
+      return *this;
+    }
+
+    bool Matches(const std::vector<void*>& cb_args) const;
+  };
+
+  // When a fault injected by SetFault fires. A hit fails if any rule
+  // matches; hits on threads other than `thread` never count or fail.
+  struct FaultSpec {
+    // each hit fails with this probability, drawn from `seed`
+    double probability = 0;
+    uint64_t seed = 0;
+    // the nth hit (from 1) fails, 0 to disable
+    uint64_t nth_hit = 0;
+    // every kth hit fails, 0 to disable
+    uint64_t every_k_hits = 0;
+    // any thread if default constructed
+    std::thread::id thread;
+    // applied to the callback arguments on a fault, before `action`
+    std::function<void(const std::vector<void*>&)> on_fault;
+    // returned to the site on a fault
+    Action action = Action::kReturn;
+  };
+
+  struct FaultStats {
+    uint64_t hits = 0;
+    uint64_t faults = 0;
+  };
+
+  // a thread parked by the step controller
+  struct ParkedThread {
+    std::thread::id thread_id;
+    std::string point;
+  };
+
+  // one scheduling decision of Explore: `thread` ran on from `point`,
+  // which is empty for the start of the body
+  struct ScheduleStep {
+    size_t thread;
+    std::string point;
+  };
+
+  struct ExploreOptions {
+    // how often a thread that could continue may be switched away from
+    size_t preemption_bound = 2;
+    // stop after this many schedules, 0 for no limit
+    size_t max_schedules = 0;
+    // whether running two points in either order may differ; independent
+    // points are not permuted. Every pair is dependent if empty.
+    std::function<bool(const std::string&, const std::string&)> dependent;
+  };
+
+  struct ExploreResult {
+    size_t schedules = 0;
+    // `check` returned false, or the threads deadlocked
+    bool failed = false;
+    bool deadlock = false;
+    std::vector<ScheduleStep> failing_schedule;
+  };
+
+  enum class RendezvousKind {
+    kBarrier,
+    kLatch,
+    kSemaphore,
+  };
+
+  enum class WatchdogAction {
+    kReport,   // only write the wait-for report to stderr
+    kAbort,    // write the report and abort, failing the test immediately
+    kRelease,  // write the report and let the stuck waiter return from Process
+  };
+
+  // how a ProcessFor / ProcessUntil call left the point
+  enum class ProcessStatus {
+    kReleased,          // predecessors cleared (or processing is disabled)
+    kTimedOut,          // the deadline passed, or the watchdog released it
+    kDisabledByMarker,  // the point is marked for another (logical) thread
+    kCancelled,         // the cancellation flag was raised
+  };
+
+  // identifies a callback added by AddCallBack
+  using CallbackHandle = uint64_t;
+
+  // Orders points against other processes or hosts, e.g. the coordinator
+  // client in sync_point_coordinator.h. Wait is called before the local
+  // predecessors are waited for, Cleared once the point is processed.
+  class Remote {
+   public:
+    virtual ~Remote() = default;
+    virtual ProcessStatus Wait(const std::string& point, const std::chrono::steady_clock::time_point* deadline,
+                               const std::atomic<bool>* cancelled) = 0;
+    virtual void Cleared(const std::string& point) = 0;
+  };
+
  private:
   SyncPoint();
   ~SyncPoint();
 
+  using ChainedCallback = std::function<Action(const std::vector<void*>&)>;
+
+  template <typename Callback>
+  static ChainedCallback ToAction(Callback callback) {
+    using Result = std::invoke_result_t<Callback&, const std::vector<void*>&>;
+    if constexpr (std::is_same_v<Result, Action>) {
+      return callback;
+    } else if constexpr (std::is_same_v<Result, bool>) {
+      return [callback = std::move(callback)](const std::vector<void*>& args) mutable {
+        return callback(args) ? Action::kContinue : Action::kSkip;
+      };
+    } else {
+      return [callback = std::move(callback)](const std::vector<void*>& args) mutable {
+        callback(args);
+        return Action::kContinue;
+      };
+    }
+  }
+
+  void SetChainedCallBack(const std::string& point, const CallbackFilter* filter, ChainedCallback callback);
+  CallbackHandle AddChainedCallBack(const std::string& point, ChainedCallback callback, int priority);
+
  public:
   SyncPoint(const SyncPoint&) = delete;
   SyncPoint(SyncPoint&&) = delete;
@@ -51,13 +238,222 @@ class SyncPoint {
   // sync points and setup markers indicating the successor is only enabled
   // when it is processed on the same thread as the predecessor.
   // When adding a marker, it implicitly adds a dependency for the marker pair.
-  void LoadDependencyAndMarkers(const std::vector<SyncPointPair>& dependencies,
-                                const std::vector<SyncPointPair>& markers = {});
+  // The graph is topologically sorted before it is installed: a cycle (which
+  // would hang in Process) is rejected, the previous graph is kept, false is
+  // returned and the cycle is described in `report` if it is not nullptr.
+  // A successor may be a glob pattern as for SetCallBack, which every
+  // matching point then waits for (not supported by markers or
+  // ProcessOrSuspend); the cycle check expands it to the points of the
+  // graph it matches. Markers are only checked for the cycles their implicit
+  // dependencies close: the graph does not say which thread reaches a point,
+  // so a marked successor its bound thread never reaches still hangs (see
+  // EnableWatchdog).
+  bool LoadDependencyAndMarkers(const std::vector<SyncPointPair>& dependencies,
+                                const std::vector<SyncPointPair>& markers = {}, std::string* report = nullptr);
+
+  // same as above, additionally loading any-of and k-of-n dependencies. A
+  // cycle through a group is only rejected when it leaves the quorum
+  // unreachable.
+  bool LoadDependencyAndMarkers(const std::vector<SyncPointPair>& dependencies,
+                                const std::vector<SyncPointPair>& markers, const std::vector<SyncPointGroup>& groups,
+                                std::string* report = nullptr);
+
+  // Dependency specs, a text form of the LoadDependencyAndMarkers arguments.
+  // Statements are separated by ';' or new lines, '#' starts a comment and
+  // names may be double quoted:
+  //   A -> B -> C; D -> C   the dependencies A -> B, B -> C and D -> C
+  //   marker X => Y         a marker; the keyword is optional
+  // A spec starting with '{' is JSON instead, with chains as arrays:
+  //   {"dependencies": [["A", "B", "C"], ["D", "C"]], "markers": [["X", "Y"]]}
+  // Returns false with the line and column of the error in `report`.
+  static bool ParseDependencies(const std::string& spec, std::vector<SyncPointPair>* dependencies,
+                                std::vector<SyncPointPair>* markers, std::string* report = nullptr);
+
+  // one edge per line, e.g. to save a minimised graph for a test
+  static std::string FormatDependencies(const std::vector<SyncPointPair>& dependencies,
+                                        const std::vector<SyncPointPair>& markers = {});
+
+  // parse and load a spec given as a string, in a file, or in the
+  // environment variable `name` either directly or as "@<file>"
+  bool LoadDependencySpec(const std::string& spec, std::string* report = nullptr);
+  bool LoadDependencyFile(const std::string& path, std::string* report = nullptr);
+  bool LoadDependencyFromEnv(const std::string& name, std::string* report = nullptr);
+
+  // while processing is enabled, enable or disable one point, or every point
+  // starting with `pattern` without its trailing '*'. The longest prefix
+  // wins, and a disabled point returns from Process straight away.
+  void SetPointEnabled(const std::string& pattern, bool enabled);
+
+  // Chaos mode: every Process call first perturbs its thread as configured
+  // for the point, drawing from a PRNG seeded from `seed`, the point, the
+  // task id of the context provider and the thread's number of hits so far,
+  // so that a thread's perturbations do not depend on other threads.
+  // `options` apply to points without their own configuration.
+  void EnableChaos(uint64_t seed, const ChaosOptions& options);
+
+  // configure chaos for one point, or for every point starting with
+  // `pattern` without its trailing '*'. Takes effect while chaos is enabled.
+  void SetChaos(const std::string& pattern, const ChaosOptions& options);
+
+  // disable chaos mode, keeping the per-point configuration
+  void DisableChaos();
+
+  // Returns the id of the logical thread running on the calling OS thread,
+  // e.g. a task id an executor keeps in a thread local, or 0 for none.
+  using ContextProvider = uint64_t (*)();
+
+  // key markers on the logical thread reported by `provider` rather than the
+  // OS thread, so a task that migrates between threads keeps its markers.
+  // nullptr (the default) restores the OS thread identity.
+  void SetContextProvider(ContextProvider provider);
+
+  // The first `count` threads reaching `point` wait until all of them have
+  // arrived, then proceed together; later threads form the next round.
+  // A count of 0 is ignored, as for SetLatch and SetSemaphore.
+  void SetBarrier(const std::string& point, size_t count);
+
+  // Threads reaching `point` wait until it has been reached `count` times in
+  // total; from then on the point never blocks.
+  void SetLatch(const std::string& point, size_t count);
+
+  // At most `permits` threads may be between `acquire_point` and
+  // `release_point`; others wait at `acquire_point` for a permit.
+  void SetSemaphore(const std::string& acquire_point, const std::string& release_point, size_t permits);
+
+  // Remove all barriers, latches and semaphores. No thread may be waiting at
+  // them, and neither may SetBarrier/SetLatch/SetSemaphore replace one that
+  // has waiters.
+  void ClearRendezvous();
+
+  // Bounded model checking: runs `setup`, then `body(i)` on `num_threads`
+  // (at most 64) pooled threads, then `check`, once per distinct ordering of
+  // the threads at their sync points, serialising them so that exactly one
+  // runs between two points. Orderings needing more than
+  // `preemption_bound` preemptions are skipped. Stops at the first failing
+  // schedule. Processing must be enabled; the body may only block at sync
+  // points, and barriers, latches and holds are not serialised.
+  ExploreResult Explore(size_t num_threads, const std::function<void()>& setup,
+                        const std::function<void(size_t)>& body, const std::function<bool()>& check,
+                        const ExploreOptions& options);
+  ExploreResult Explore(size_t num_threads, const std::function<void()>& setup,
+                        const std::function<void(size_t)>& body, const std::function<bool()>& check);
+
+  // Delta debugging: shrinks `dependencies` to a 1-minimal list for which
+  // `fails` still returns true, e.g. one from ScheduleToDependencies. Each
+  // candidate runs in a forked child with the candidate loaded, `jobs` of
+  // them at a time; a child crashing counts as failing. One still running
+  // after `timeout` is killed and run once more, as is one fork failed to
+  // start, and is inconclusive if that happens again: it is never chosen,
+  // so the result is only 1-minimal among conclusive candidates. A hang
+  // that is the failure must be turned into `true` by `fails` itself, e.g.
+  // with ProcessFor. The child only has the forking thread, so `fails`
+  // must start any threads it relies on. Returns `dependencies` unchanged
+  // if it does not fail itself.
+  std::vector<SyncPointPair> MinimizeDependencies(const std::vector<SyncPointPair>& dependencies,
+                                                  const std::function<bool()>& fails, size_t jobs = 1,
+                                                  std::chrono::milliseconds timeout = std::chrono::seconds(10));
+
+  // Turns `schedule` into dependencies for LoadDependencyAndMarkers under
+  // which threads pass their sync points in the order of the schedule: a
+  // step run after another thread's waits for the last point passed before
+  // it, and a step from the start of a body moves to the thread's first
+  // point. A point is only recorded once passed, so what a thread runs after
+  // its last passed point, before it was switched away, is not held back.
+  // Fails, describing why in `report`, if a point is reached more than once
+  // or by several threads, as an edge cannot tell such hits apart, or if a
+  // thread to be ordered never reaches a point.
+  static bool ScheduleToDependencies(const std::vector<ScheduleStep>& schedule,
+                                     std::vector<SyncPointPair>* dependencies, std::string* report = nullptr);
+
+  // Step controller: park every thread reaching one of `points`, once its
+  // predecessors are cleared and before its callback runs, until Step
+  // releases it.
+  void HoldAt(const std::vector<std::string>& points);
+
+  // stop holding at any point and release every parked thread
+  void ClearHolds();
+
+  // threads currently parked by HoldAt, in the order they arrived
+  std::vector<ParkedThread> ParkedThreads();
+
+  // wait until at least `count` threads are parked; false on timeout
+  bool WaitForParked(size_t count, std::chrono::steady_clock::duration timeout);
+
+  // release exactly the thread `thread_id` from its parked point, false if
+  // it is not parked. It is held again at the next point in the hold set.
+  bool Step(std::thread::id thread_id);
 
   // The argument to the callback is passed through from
   // TEST_SYNC_POINT_CALLBACK(); nullptr if TEST_SYNC_POINT or
   // TEST_IDX_SYNC_POINT was used.
-  void SetCallBack(const std::string& point, const std::function<void(const std::vector<void*>&)>& callback);
+  // `point` may be a glob pattern, where '*' matches any run of characters
+  // and '?' any one character, e.g. "Compaction:*". An exact callback takes
+  // precedence, then the pattern with the most literal characters.
+  // Replaces every callback of `point`, see AddCallBack.
+  template <typename Callback>
+  void SetCallBack(const std::string& point, Callback callback) {
+    SetChainedCallBack(point, nullptr, ToAction(std::move(callback)));
+  }
+
+  // Same, but the callbacks only run for hits matching `filter`; a filter on
+  // a pattern applies to the points resolved to its callbacks. A rejected
+  // hit still waits and clears the point, unless nothing orders the point
+  // (no dependency, marker, group, hold or rendezvous): then Process drops
+  // it before taking any lock, with one lookup. The filter stays until the
+  // callback is set again or cleared.
+  template <typename Callback>
+  void SetCallBack(const std::string& point, const CallbackFilter& filter, Callback callback) {
+    SetChainedCallBack(point, &filter, ToAction(std::move(callback)));
+  }
+
+  // Adds `callback` to the chain of `point` (a point or a pattern, as for
+  // SetCallBack), for several tools to attach to the same point. The chain
+  // runs highest `priority` first, in the order added for equal priorities.
+  // A callback may return an Action: the chain ends at the first one other
+  // than kContinue, which Process returns to the site. A callback returning
+  // bool ends the chain by returning false (kSkip). Running a chain neither
+  // allocates nor holds the lock.
+  template <typename Callback>
+  CallbackHandle AddCallBack(const std::string& point, Callback callback, int priority = 0) {
+    return AddChainedCallBack(point, ToAction(std::move(callback)), priority);
+  }
+
+  // remove one callback added by AddCallBack, once no callback is running;
+  // false if it is already gone
+  bool RemoveCallBack(CallbackHandle handle);
+
+  // Built-in callbacks for SetCallBack which disturb the calling thread, to
+  // open cross-core timing windows (Linux only).
+  // Moves the thread to the next CPU it may run on; its affinity is kept.
+  static std::function<void(const std::vector<void*>&)> MigrateThreadAction();
+  // Raises the thread's nice value by `nice_increment`. Unprivileged
+  // threads cannot lower it again.
+  static std::function<void(const std::vector<void*>&)> LowerPriorityAction(int nice_increment);
+  // Gives up the CPU even when no other thread is runnable on it.
+  static std::function<void(const std::vector<void*>&)> ContextSwitchAction();
+
+  // Fault injection: adds a callback to `point` so that hits fail as
+  // described by `spec`, replacing the one of a previous SetFault there.
+  // The decision costs a few atomic operations. Returns the handle of the
+  // callback, for RemoveCallBack.
+  CallbackHandle SetFault(const std::string& point, const FaultSpec& spec);
+
+  // hits and faults counted at `point` by its latest SetFault
+  FaultStats GetFaultStats(const std::string& point);
+
+  // Allocation failure injection: once `begin_point` is processed on a
+  // thread (only on `thread`, if given), the `nth` following operator new
+  // call on that thread throws std::bad_alloc (nothrow forms return
+  // nullptr), unless `end_point` is processed first. Adds a callback to
+  // both points and returns their handles, begin first, for RemoveCallBack.
+  // Allocations inside Process are not counted, but building the arguments
+  // of the end point's TEST_SYNC_POINT (e.g. a long name) is.
+  // Needs the global operator new hook, which sync_point.cc only installs
+  // when SYNC_POINT_ALLOCATION_HOOK is defined; without it no allocation
+  // fails.
+  std::pair<CallbackHandle, CallbackHandle> FailAllocationBetween(const std::string& begin_point,
+                                                                  const std::string& end_point, uint64_t nth,
+                                                                  std::thread::id thread = {});
 
   // Clear callback function by point
   void ClearCallBack(const std::string& point);
@@ -65,14 +461,172 @@ class SyncPoint {
   // Clear all call back functions.
   void ClearAllCallBacks();
 
+  // Virtual time: TEST_SYNC_POINT_SLEEP parks the thread until a logical
+  // clock, starting at zero, reaches its deadline. Once `num_threads`
+  // participants are all asleep or blocked in Process, the clock jumps to
+  // the earliest deadline. A thread counts as a participant from its first
+  // sync point or sleep on, and stops counting when it exits, so
+  // `num_threads` are the threads reaching sync points while enabled.
+  void EnableVirtualTime(size_t num_threads);
+
+  // go back to real sleeps, waking every virtual sleeper
+  void DisableVirtualTime();
+
+  // the logical clock, since EnableVirtualTime
+  std::chrono::nanoseconds VirtualNow();
+
+  // triggered by TEST_SYNC_POINT_SLEEP: processes `point`, then sleeps for
+  // `duration` in virtual time if enabled, or in real time.
+  void SleepFor(const std::string& point, std::chrono::nanoseconds duration);
+
   // remove the execution trace of all sync points
   void ClearTrace();
 
+  // start a watchdog thread which reports every Process call blocked for
+  // longer than `deadline`, then applies `action` to it once.
+  void EnableWatchdog(std::chrono::milliseconds deadline, WatchdogAction action = WatchdogAction::kReport);
+
+  // stop the watchdog thread
+  void DisableWatchdog();
+
+  // describe every thread currently blocked in Process: its point, how long
+  // it has waited and the predecessors it is still waiting for.
+  std::string DumpWaiters();
+
   // triggered by TEST_SYNC_POINT, blocking execution until all predecessors
   // are executed.
-  // And/or call registered callback function, with argument `cb_arg`
+  // And/or call registered callback function, with argument `cb_arg`,
+  // returning the action of the chain (kSkip is returned as kContinue)
   // void Process(const std::string& point, void* cb_arg = nullptr);
-  void Process(const std::string& point, const std::vector<void*>& cb_args = {});
+  Action Process(const std::string& point, const std::vector<void*>& cb_args = {});
+
+  // Acts on a non-continue action at a site: throws InjectedFault for
+  // kThrow, aborts for kAbort, and returns whether to return for kReturn.
+  static bool TakeAction(Action action, const std::string& point);
+
+  // Same as Process, but gives up waiting for predecessors after `timeout`
+  // or at `deadline`; the callback is not called and the point is not
+  // cleared unless kReleased is returned. The wait parks on the same
+  // condition variable as Process. A waiter also gives up once `*cancelled`
+  // is set, provided WakeWaiters is called after setting it.
+  ProcessStatus ProcessFor(const std::string& point, std::chrono::steady_clock::duration timeout,
+                           const std::vector<void*>& cb_args = {});
+  ProcessStatus ProcessUntil(const std::string& point, std::chrono::steady_clock::time_point deadline,
+                             const std::vector<void*>& cb_args = {}, const std::atomic<bool>* cancelled = nullptr);
+
+  // wake every blocked Process call so it re-checks its cancellation flag
+  void WakeWaiters();
+
+  // Non-blocking Process: if the predecessors of `point` are cleared, it is
+  // processed right away and true is returned. Otherwise false is returned,
+  // and the thread that clears the last predecessor processes the point and
+  // then calls `resume(kReleased, action)`. If LoadDependencyAndMarkers or
+  // ClearTrace runs first, the point is left unprocessed and
+  // `resume(kCancelled, kContinue)` is called instead. Barriers, latches,
+  // semaphores and holds do not apply.
+  // The chain's kThrow or kAbort is taken as by TakeAction, here for a point
+  // processed right away and by whoever `resume` hands it to otherwise;
+  // kSkip and kReturn have no site to act on. A shared point whose shared
+  // predecessors are not all cleared, and any point while a Remote is
+  // installed, cannot be suspended: it is refused, left unprocessed, with
+  // `resume(kCancelled, kContinue)` called before false is returned.
+  bool ProcessOrSuspend(const std::string& point, std::function<void(ProcessStatus, Action)> resume);
+
+  // Multi-process mode: `dependencies` are compiled into the POSIX shared
+  // memory segment `name` (e.g. "/my_test"), which sibling processes attach
+  // to and forked children inherit. Points of the shared graph are then
+  // ordered across processes through futexes in the segment; other points
+  // still use the local graph, where they may wait for shared points.
+  // Callbacks stay per process, and markers and groups are not supported.
+  // A waiter gives up once no other attached process is alive. Returns
+  // false, describing why in `report`, if the graph has a cycle or the
+  // segment is in use by live processes.
+  bool CreateSharedGraph(const std::string& name, const std::vector<SyncPointPair>& dependencies,
+                         std::string* report = nullptr);
+
+  // attach to a shared graph created by another process
+  bool AttachSharedGraph(const std::string& name, std::string* report = nullptr);
+
+  // leave multi-process mode; in the creating process also unlinks the segment
+  void DetachSharedGraph();
+
+  // install `remote`, or remove it with nullptr. It is not owned and must
+  // outlive every Process call that may still be using it.
+  void SetRemote(Remote* remote);
+
+  // For event loops, which must never block in Process.
+  // process `point` and return true if its predecessors are cleared, or
+  // return false leaving it unprocessed. Shared points are checked against
+  // the shared graph, and while a Remote is installed every point is refused
+  // with false; see ProcessOrSuspend.
+  bool TryProcess(const std::string& point);
+
+  // process `point` once its predecessors are cleared and queue `on_ready`.
+  // Queued completions are signalled on CompletionFd and run by
+  // RunCompletions, on the loop thread. `on_ready` is queued unprocessed
+  // too if the wait is cancelled or refused, as for ProcessOrSuspend. The
+  // chain's kThrow of a point processed later is thrown from RunCompletions.
+  void ProcessAsync(const std::string& point, std::function<void()> on_ready);
+
+  // an eventfd, readable while completions are queued; owned by SyncPoint
+  int CompletionFd();
+
+  // run all queued completions, returns how many ran. If one throws, the
+  // rest stay queued for the next call.
+  size_t RunCompletions();
+
+#if __cplusplus >= 202002L
+  // cancellable through std::stop_source::request_stop
+  ProcessStatus ProcessUntil(const std::string& point, std::chrono::steady_clock::time_point deadline,
+                             std::stop_token token, const std::vector<void*>& cb_args = {}) {
+    std::atomic<bool> cancelled = false;
+    std::stop_callback on_stop(token, [&] {
+      cancelled = true;
+      WakeWaiters();
+    });
+    return ProcessUntil(point, deadline, cb_args, &cancelled);
+  }
+
+  // resumes the coroutine on the thread that released it
+  struct InlineExecutor {
+    void operator()(std::coroutine_handle<> handle) const { handle.resume(); }
+  };
+
+  template <typename Executor>
+  struct Awaiter {
+    std::string point;
+    Executor executor;
+    ProcessStatus status = ProcessStatus::kReleased;
+    Action action = Action::kContinue;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      auto resume = [this, executor = executor, handle](ProcessStatus resumed, Action chain_action) mutable {
+        status = resumed;
+        action = chain_action;
+        executor(handle);
+      };
+      return !GetInstance()->ProcessOrSuspend(point, std::move(resume));
+    }
+    ProcessStatus await_resume() const {
+      if (action != Action::kContinue) {
+        TakeAction(action, point);
+      }
+      return status;
+    }
+  };
+
+  // `co_await SyncPoint::Async(point)` suspends the coroutine rather than
+  // blocking its thread until `point` is processed. `executor(handle)` is
+  // then called to resume it, e.g. to post it back onto its own pool. It
+  // evaluates to kReleased, or kCancelled as for ProcessOrSuspend, and a
+  // deferred kThrow is thrown into the coroutine.
+  static Awaiter<InlineExecutor> Async(std::string point) { return {std::move(point), {}}; }
+  template <typename Executor>
+  static Awaiter<Executor> Async(std::string point, Executor executor) {
+    return {std::move(point), std::move(executor)};
+  }
+#endif
 };
 
 }  // namespace utils
@@ -85,19 +639,25 @@ class SyncPoint {
 #define TEST_SYNC_POINT(x) utils::SyncPoint::GetInstance()->Process(x)
 #define TEST_IDX_SYNC_POINT(x, index) utils::SyncPoint::GetInstance()->Process(x + std::to_string(index))
 #define TEST_SYNC_POINT_ARGS(x, ...) utils::SyncPoint::GetInstance()->Process(x, std::vector<void*>{__VA_ARGS__})
-#define TEST_SYNC_POINT_RETURN_VOID(x) \
-  {                                    \
-    bool flag = false;                 \
-    TEST_SYNC_POINT_ARGS(x, &flag);    \
-    if (flag) return;                  \
+#define TEST_SYNC_POINT_RETURN_VOID(x)                                                                           \
+  {                                                                                                              \
+    const auto& sp_point = (x);                                                                                  \
+    auto sp_action = utils::SyncPoint::GetInstance()->Process(sp_point);                                         \
+    if (sp_action != utils::SyncPoint::Action::kContinue && utils::SyncPoint::TakeAction(sp_action, sp_point)) { \
+      return;                                                                                                    \
+    }                                                                                                            \
   }
-#define TEST_SYNC_POINT_RETURN_VALUE(x, val_ptr)                                                    \
-  {                                                                                                 \
-    static_assert(!std::is_same_v<decltype(val_ptr), std::nullptr_t>, "val_ptr cannot be nullptr"); \
-    bool flag = false;                                                                              \
-    TEST_SYNC_POINT_ARGS(x, &flag, val_ptr);                                                        \
-    if (flag) return *val_ptr;                                                                      \
+#define TEST_SYNC_POINT_RETURN_VALUE(x, val_ptr)                                                                 \
+  {                                                                                                              \
+    static_assert(!std::is_same_v<decltype(val_ptr), std::nullptr_t>, "val_ptr cannot be nullptr");              \
+    const auto& sp_point = (x);                                                                                  \
+    auto sp_action = TEST_SYNC_POINT_ARGS(sp_point, val_ptr);                                                    \
+    if (sp_action != utils::SyncPoint::Action::kContinue && utils::SyncPoint::TakeAction(sp_action, sp_point)) { \
+      return *val_ptr;                                                                                           \
+    }                                                                                                            \
   }
+#define TEST_SYNC_POINT_SLEEP(x, duration) utils::SyncPoint::GetInstance()->SleepFor(x, duration)
+#define TEST_SYNC_POINT_AWAIT(x) co_await utils::SyncPoint::Async(x)
 #define INIT_SYNC_POINT_SINGLETONS() (void)utils::SyncPoint::GetInstance();
 #else
 #define TEST_SYNC_POINT(x)
@@ -105,5 +665,7 @@ class SyncPoint {
 #define TEST_SYNC_POINT_ARGS(x, ...)
 #define TEST_SYNC_POINT_RETURN_VOID(x)
 #define TEST_SYNC_POINT_RETURN_VALUE(x, val_ptr)
+#define TEST_SYNC_POINT_SLEEP(x, duration) std::this_thread::sleep_for(duration)
+#define TEST_SYNC_POINT_AWAIT(x) co_await std::suspend_never{}
 #define INIT_SYNC_POINT_SINGLETONS()
 #endif  // UNIT_TEST
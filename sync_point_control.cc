@@ -0,0 +1,222 @@
+#include "sync_point_control.h"
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "sync_point.h"
+
+#ifdef UNIT_TEST
+namespace utils {
+
+namespace {
+
+struct Listener {
+  std::string path;
+  int listen_fd = -1;
+  // written by StopControlSocket to wake the listener
+  int stop_fd = -1;
+  std::thread thread;
+  // the callback of each point with an action, for stats and clear
+  std::map<std::string, SyncPoint::CallbackHandle> actions;
+};
+
+std::mutex listener_mutex;
+std::unique_ptr<Listener> listener;
+
+// Runs one command line and returns its reply.
+std::string Execute(Listener& state, const std::string& line) {
+  std::istringstream in(line);
+  std::string command;
+  std::vector<std::string> args;
+  in >> command;
+  for (std::string arg; in >> arg;) {
+    args.push_back(std::move(arg));
+  }
+  auto* sync_point = SyncPoint::GetInstance();
+
+  if ((command == "enable" || command == "disable") && args.size() <= 1) {
+    bool enable = command == "enable";
+    if (args.empty()) {
+      enable ? sync_point->EnableProcessing() : sync_point->DisableProcessing();
+    } else {
+      sync_point->SetPointEnabled(args[0], enable);
+    }
+  } else if (command == "load" && args.size() % 2 == 0) {
+    std::vector<SyncPoint::SyncPointPair> dependencies;
+    for (size_t i = 0; i < args.size(); i += 2) {
+      dependencies.push_back({args[i], args[i + 1]});
+    }
+    std::string report;
+    if (!sync_point->LoadDependencyAndMarkers(dependencies, {}, &report)) {
+      return "ERR " + report + "\n";
+    }
+  } else if (command == "action" && args.size() >= 2) {
+    const auto& point = args[0];
+    const auto& action = args[1];
+    SyncPoint::FaultSpec spec;
+    try {
+      if (action == "delay" && args.size() == 3) {
+        auto delay = std::chrono::milliseconds(std::stoll(args[2]));
+        spec.every_k_hits = 1;
+        spec.on_fault = [delay](const std::vector<void*>&) { std::this_thread::sleep_for(delay); };
+        spec.action = SyncPoint::Action::kContinue;
+      } else if (action == "fail" && args.size() <= 3) {
+        if (args.size() == 3) {
+          spec.nth_hit = std::stoull(args[2]);
+        } else {
+          spec.every_k_hits = 1;
+        }
+      } else if (action != "count" || args.size() != 2) {
+        return "ERR unknown action: " + line + "\n";
+      }
+    } catch (const std::exception&) {
+      return "ERR bad number: " + line + "\n";
+    }
+    // every action is a fault, so hits and faults are counted alike, and
+    // SetFault replaces the previous action of the point
+    state.actions[point] = sync_point->SetFault(point, spec);
+  } else if (command == "clear" && args.size() == 1) {
+    // only the action goes, other callbacks of the point stay
+    auto iter = state.actions.find(args[0]);
+    if (iter == state.actions.end()) {
+      return "ERR no action: " + line + "\n";
+    }
+    sync_point->RemoveCallBack(iter->second);
+    state.actions.erase(iter);
+  } else if (command == "stats" && args.empty()) {
+    std::string out;
+    for (const auto& [point, handle] : state.actions) {
+      auto stats = sync_point->GetFaultStats(point);
+      out += point + " " + std::to_string(stats.hits) + " " + std::to_string(stats.faults) + "\n";
+    }
+    return out + "OK\n";
+  } else {
+    return "ERR unknown command: " + line + "\n";
+  }
+  return "OK\n";
+}
+
+void Serve(Listener& state) {
+  std::vector<int> connections;
+  std::vector<std::string> inputs;
+  std::vector<pollfd> fds;
+  char buf[4096];
+  while (true) {
+    fds.clear();
+    fds.push_back({state.stop_fd, POLLIN, 0});
+    fds.push_back({state.listen_fd, POLLIN, 0});
+    for (int fd : connections) {
+      fds.push_back({fd, POLLIN, 0});
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR) {
+      break;
+    }
+    if (fds[0].revents != 0) {
+      break;
+    }
+    // closed connections are dropped from the back so indices stay valid
+    for (size_t i = fds.size(); i-- > 2;) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      size_t index = i - 2;
+      ssize_t ret = recv(connections[index], buf, sizeof(buf), 0);
+      if (ret < 0 && errno == EINTR) {
+        continue;
+      }
+      bool open = ret > 0;
+      if (open) {
+        auto& input = inputs[index];
+        input.append(buf, static_cast<size_t>(ret));
+        std::string reply;
+        size_t begin = 0;
+        for (size_t end; (end = input.find('\n', begin)) != std::string::npos; begin = end + 1) {
+          reply += Execute(state, input.substr(begin, end - begin));
+        }
+        input.erase(0, begin);
+        open = reply.empty() || send(connections[index], reply.data(), reply.size(), MSG_NOSIGNAL) >= 0;
+      }
+      if (!open) {
+        close(connections[index]);
+        connections.erase(connections.begin() + static_cast<ptrdiff_t>(index));
+        inputs.erase(inputs.begin() + static_cast<ptrdiff_t>(index));
+      }
+    }
+    if (fds[1].revents & POLLIN) {
+      int fd = accept4(state.listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd >= 0) {
+        connections.push_back(fd);
+        inputs.emplace_back();
+      }
+    }
+  }
+  for (int fd : connections) {
+    close(fd);
+  }
+}
+
+}  // namespace
+
+bool StartControlSocket(const std::string& path, std::string* report) {
+  StopControlSocket();
+  auto fail = [&](const std::string& error) {
+    if (report != nullptr) {
+      *report = error;
+    }
+    return false;
+  };
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return fail("socket path too long: " + path);
+  }
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return fail(std::string("socket: ") + strerror(errno));
+  }
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+    std::string error = path + ": " + strerror(errno);
+    close(fd);
+    return fail(error);
+  }
+
+  std::lock_guard lock(listener_mutex);
+  listener = std::make_unique<Listener>();
+  listener->path = path;
+  listener->listen_fd = fd;
+  listener->stop_fd = eventfd(0, EFD_CLOEXEC);
+  listener->thread = std::thread([state = listener.get()] { Serve(*state); });
+  return true;
+}
+
+void StopControlSocket() {
+  std::lock_guard lock(listener_mutex);
+  if (listener == nullptr) {
+    return;
+  }
+  uint64_t one = 1;
+  while (write(listener->stop_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+  }
+  listener->thread.join();
+  close(listener->listen_fd);
+  close(listener->stop_fd);
+  unlink(listener->path.c_str());
+  listener.reset();
+}
+
+}  // namespace utils
+#endif  // UNIT_TEST
@@ -0,0 +1,33 @@
+// Runtime control of sync points over a Unix domain socket, companion of
+// sync_point.h.
+
+#pragma once
+
+#include <string>
+
+namespace utils {
+
+#ifdef UNIT_TEST
+// Serves the commands below on the Unix domain socket `path`, one per
+// line, from a background thread, so that a running process can be
+// perturbed live (e.g. with socat). Each command is answered with "OK",
+// preceded by any output, or with "ERR <reason>". Commands take effect
+// through the public SyncPoint API, so Process never waits on the listener.
+//
+//   enable | disable                  all processing
+//   enable | disable <pattern>        one point, or a prefix ending in '*'
+//   load <pred> <succ> ...            replace the graph with these pairs
+//   action <point> delay <ms>         sleep at every hit
+//   action <point> fail [<nth>]       return early from TEST_SYNC_POINT_RETURN_*
+//                                     at every hit, or only at the nth
+//   action <point> count              only count hits
+//   clear <point>                     remove the action, keeping the other
+//                                     callbacks of the point
+//   stats                             "<point> <hits> <faults>" per action
+bool StartControlSocket(const std::string& path, std::string* report = nullptr);
+
+// stop serving and remove the socket; actions stay in place
+void StopControlSocket();
+#endif  // UNIT_TEST
+
+}  // namespace utils
@@ -0,0 +1,94 @@
+#include "sync_point_control.h"
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+#include "sync_point.h"
+
+// NOLINTNEXTLINE
+using namespace utils;
+
+/************************************************************************/
+/* SyncPointControlTest */
+/************************************************************************/
+class SyncPointControlTest : public testing::Test {};
+
+namespace {
+
+// Sends `command` and returns the reply up to its final "OK" or "ERR" line.
+std::string Send(int fd, const std::string& command) {
+  std::string line = command + "\n";
+  EXPECT_EQ(send(fd, line.data(), line.size(), 0), static_cast<ssize_t>(line.size()));
+  std::string reply;
+  char buf[256];
+  while (reply.compare(0, 3, "OK\n") != 0 && reply.find("\nOK\n") == std::string::npos &&
+         reply.compare(0, 4, "ERR ") != 0) {
+    ssize_t ret = recv(fd, buf, sizeof(buf), 0);
+    if (ret <= 0) {
+      break;
+    }
+    reply.append(buf, static_cast<size_t>(ret));
+  }
+  return reply;
+}
+
+void ReturnEarly(bool* returned) {
+  *returned = true;
+  TEST_SYNC_POINT_RETURN_VOID("SyncPointControlTest::Fail");
+  *returned = false;
+}
+
+}  // namespace
+
+TEST_F(SyncPointControlTest, Commands) {
+  const std::string path = "/tmp/sync_point_control_test.sock";
+  std::string report;
+  ASSERT_TRUE(StartControlSocket(path, &report)) << report;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path.c_str());
+  ASSERT_EQ(connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)), 0);
+
+  ASSERT_EQ(Send(fd, "enable"), "OK\n");
+  ASSERT_EQ(Send(fd, "action SyncPointControlTest::Count count"), "OK\n");
+  ASSERT_EQ(Send(fd, "action SyncPointControlTest::Fail fail"), "OK\n");
+  for (int i = 0; i < 3; ++i) {
+    TEST_SYNC_POINT("SyncPointControlTest::Count");
+  }
+  bool returned = false;
+  ReturnEarly(&returned);
+  ASSERT_TRUE(returned);
+  ASSERT_EQ(Send(fd, "stats"), "SyncPointControlTest::Count 3 0\nSyncPointControlTest::Fail 1 1\nOK\n");
+
+  // a disabled point neither counts nor waits for its predecessor
+  ASSERT_EQ(Send(fd, "load SyncPointControlTest::Never SyncPointControlTest::Count"), "OK\n");
+  ASSERT_EQ(Send(fd, "disable SyncPointControlTest::C*"), "OK\n");
+  TEST_SYNC_POINT("SyncPointControlTest::Count");
+  ASSERT_EQ(Send(fd, "stats"), "SyncPointControlTest::Count 3 0\nSyncPointControlTest::Fail 1 1\nOK\n");
+  ASSERT_EQ(Send(fd, "enable SyncPointControlTest::C*"), "OK\n");
+
+  ASSERT_EQ(Send(fd, "load SyncPointControlTest::A"), "ERR unknown command: load SyncPointControlTest::A\n");
+  ASSERT_EQ(Send(fd, "action SyncPointControlTest::Count explode"),
+            "ERR unknown action: action SyncPointControlTest::Count explode\n");
+  // clear removes the action only
+  int hits = 0;
+  SyncPoint::GetInstance()->AddCallBack("SyncPointControlTest::Count", [&](const std::vector<void*>&) { hits++; });
+  ASSERT_EQ(Send(fd, "clear SyncPointControlTest::Count"), "OK\n");
+  ASSERT_EQ(Send(fd, "clear SyncPointControlTest::Count"), "ERR no action: clear SyncPointControlTest::Count\n");
+  ASSERT_EQ(Send(fd, "clear SyncPointControlTest::Fail"), "OK\n");
+  ASSERT_EQ(Send(fd, "load"), "OK\n");
+  ReturnEarly(&returned);
+  ASSERT_FALSE(returned);
+  TEST_SYNC_POINT("SyncPointControlTest::Count");
+  ASSERT_EQ(hits, 1);
+  ASSERT_EQ(SyncPoint::GetInstance()->GetFaultStats("SyncPointControlTest::Count").hits, 3);
+  ASSERT_EQ(Send(fd, "disable"), "OK\n");
+
+  close(fd);
+  StopControlSocket();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  SyncPoint::GetInstance()->ClearTrace();
+}
@@ -0,0 +1,489 @@
+#include "sync_point_coordinator.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace utils {
+
+namespace {
+
+// Creates a socket for `address` and binds and listens on it, or connects
+// it. Returns -1 with `*error` set on failure.
+int OpenSocket(const std::string& address, bool listening, std::string* error) {
+  if (!address.empty() && address[0] == '/') {
+    sockaddr_un addr{};
+    if (address.size() >= sizeof(addr.sun_path)) {
+      *error = "socket path too long: " + address;
+      return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, address.c_str(), address.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      *error = std::string("socket: ") + strerror(errno);
+      return -1;
+    }
+    if (listening) {
+      unlink(address.c_str());
+    }
+    auto* sockaddr = reinterpret_cast<const struct sockaddr*>(&addr);
+    if (listening ? bind(fd, sockaddr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0
+                  : connect(fd, sockaddr, sizeof(addr)) != 0) {
+      *error = address + ": " + strerror(errno);
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  auto colon = address.rfind(':');
+  if (colon == std::string::npos) {
+    *error = "expected a socket path or host:port, got " + address;
+    return -1;
+  }
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listening ? AI_PASSIVE : 0;
+  addrinfo* infos = nullptr;
+  int ret = getaddrinfo(address.substr(0, colon).c_str(), address.substr(colon + 1).c_str(), &hints, &infos);
+  if (ret != 0) {
+    *error = address + ": " + gai_strerror(ret);
+    return -1;
+  }
+  int fd = -1;
+  for (auto* info = infos; info != nullptr && fd < 0; info = info->ai_next) {
+    fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, info->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (listening ? bind(fd, info->ai_addr, info->ai_addrlen) != 0 || listen(fd, SOMAXCONN) != 0
+                  : connect(fd, info->ai_addr, info->ai_addrlen) != 0) {
+      *error = address + ": " + strerror(errno);
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(infos);
+  return fd;
+}
+
+bool WriteAll(int fd, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t ret = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      return false;
+    }
+    written += static_cast<size_t>(ret);
+  }
+  return true;
+}
+
+}  // namespace
+
+/************************************************************************/
+/* SyncPointCoordinator */
+/************************************************************************/
+struct SyncPointCoordinator::State {
+  struct Connection {
+    int fd;
+    std::string in;
+    std::string out;
+  };
+
+  std::string address;
+  int listen_fd = -1;
+  // written by Stop to wake the serving thread
+  int stop_fd = -1;
+  std::thread server;
+
+  // guarded by `mutex`, held by the serving thread while it handles requests
+  std::mutex mutex;
+  std::unordered_set<std::string> cleared;
+  // point -> (connection fd, wait id)
+  std::unordered_map<std::string, std::vector<std::pair<int, std::string>>> waiters;
+  std::unordered_map<int, Connection> connections;
+
+  void Serve() {
+    std::vector<pollfd> fds;
+    char buf[4096];
+    while (true) {
+      fds.clear();
+      fds.push_back({stop_fd, POLLIN, 0});
+      fds.push_back({listen_fd, POLLIN, 0});
+      for (const auto& [fd, connection] : connections) {
+        fds.push_back({fd, POLLIN, 0});
+      }
+      if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR) {
+        return;
+      }
+      if (fds[0].revents != 0) {
+        return;
+      }
+      std::lock_guard lock(mutex);
+      if (fds[1].revents & POLLIN) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+          connections.emplace(fd, Connection{fd, {}, {}});
+        }
+      }
+      for (size_t i = 2; i < fds.size(); ++i) {
+        if (fds[i].revents == 0) {
+          continue;
+        }
+        ssize_t ret = recv(fds[i].fd, buf, sizeof(buf), 0);
+        if (ret <= 0) {
+          if (ret < 0 && errno == EINTR) {
+            continue;
+          }
+          Disconnect(fds[i].fd);
+          continue;
+        }
+        auto& connection = connections[fds[i].fd];
+        connection.in.append(buf, static_cast<size_t>(ret));
+        size_t begin = 0;
+        for (size_t end; (end = connection.in.find('\n', begin)) != std::string::npos; begin = end + 1) {
+          Handle(connection, connection.in.substr(begin, end - begin));
+        }
+        connection.in.erase(0, begin);
+      }
+      // every reply produced by this round goes out in one write per node
+      std::vector<int> failed;
+      for (auto& [fd, connection] : connections) {
+        if (!connection.out.empty() && !WriteAll(fd, std::exchange(connection.out, {}))) {
+          failed.push_back(fd);
+        }
+      }
+      for (int fd : failed) {
+        Disconnect(fd);
+      }
+    }
+  }
+
+  // Requires mutex.
+  void Handle(Connection& connection, const std::string& line) {
+    if (line.compare(0, 2, "C ") == 0) {
+      auto point = line.substr(2);
+      auto waiters_iter = waiters.find(point);
+      if (waiters_iter != waiters.end()) {
+        for (const auto& [fd, id] : waiters_iter->second) {
+          connections[fd].out += "D " + id + "\n";
+        }
+        waiters.erase(waiters_iter);
+      }
+      cleared.insert(std::move(point));
+    } else if (line.compare(0, 2, "W ") == 0) {
+      auto space = line.find(' ', 2);
+      if (space == std::string::npos) {
+        return;
+      }
+      auto id = line.substr(2, space - 2);
+      auto point = line.substr(space + 1);
+      if (cleared.count(point) > 0) {
+        connection.out += "D " + id + "\n";
+      } else {
+        waiters[point].emplace_back(connection.fd, std::move(id));
+      }
+    }
+  }
+
+  // Requires mutex.
+  void Disconnect(int fd) {
+    for (auto& [point, point_waiters] : waiters) {
+      point_waiters.erase(std::remove_if(point_waiters.begin(), point_waiters.end(),
+                                         [fd](const auto& waiter) { return waiter.first == fd; }),
+                          point_waiters.end());
+    }
+    connections.erase(fd);
+    close(fd);
+  }
+};
+
+SyncPointCoordinator::SyncPointCoordinator() : state_(std::make_unique<State>()) {}
+
+SyncPointCoordinator::~SyncPointCoordinator() { Stop(); }
+
+bool SyncPointCoordinator::Start(const std::string& address, std::string* report) {
+  Stop();
+  std::string error;
+  state_->listen_fd = OpenSocket(address, true, &error);
+  if (state_->listen_fd < 0) {
+    if (report != nullptr) {
+      *report = std::move(error);
+    }
+    return false;
+  }
+  state_->address = address;
+  sockaddr_storage addr{};
+  socklen_t len = sizeof(addr);
+  if (address[0] != '/' && getsockname(state_->listen_fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0) {
+    auto port = addr.ss_family == AF_INET6 ? reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port
+                                           : reinterpret_cast<sockaddr_in*>(&addr)->sin_port;
+    state_->address = address.substr(0, address.rfind(':') + 1) + std::to_string(ntohs(port));
+  }
+  state_->stop_fd = eventfd(0, EFD_CLOEXEC);
+  state_->server = std::thread([this] { state_->Serve(); });
+  return true;
+}
+
+void SyncPointCoordinator::Stop() {
+  if (!state_->server.joinable()) {
+    return;
+  }
+  uint64_t one = 1;
+  while (write(state_->stop_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+  }
+  state_->server.join();
+  std::lock_guard lock(state_->mutex);
+  for (const auto& [fd, connection] : state_->connections) {
+    close(fd);
+  }
+  state_->connections.clear();
+  state_->waiters.clear();
+  close(state_->listen_fd);
+  close(state_->stop_fd);
+  if (state_->address[0] == '/') {
+    unlink(state_->address.c_str());
+  }
+}
+
+std::string SyncPointCoordinator::Address() const { return state_->address; }
+
+void SyncPointCoordinator::Reset() {
+  std::lock_guard lock(state_->mutex);
+  state_->cleared.clear();
+}
+
+#ifdef UNIT_TEST
+/************************************************************************/
+/* CoordinatorClient */
+/************************************************************************/
+namespace {
+
+class CoordinatorClient : public SyncPoint::Remote {
+ private:
+  int fd_;
+  // local point -> its predecessors on other nodes
+  std::unordered_map<std::string, std::vector<std::string>> remote_predecessors_;
+  // local points with successors on other nodes
+  std::unordered_set<std::string> reported_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable writer_cv_;
+  // requests not yet written, batched by the writer thread
+  std::string pending_;
+  uint64_t next_id_ = 0;
+  std::unordered_set<uint64_t> done_;
+  bool closed_ = false;
+  std::thread reader_;
+  std::thread writer_;
+
+ public:
+  CoordinatorClient(int fd, std::unordered_map<std::string, std::vector<std::string>> remote_predecessors,
+                    std::unordered_set<std::string> reported)
+      : fd_(fd), remote_predecessors_(std::move(remote_predecessors)), reported_(std::move(reported)) {
+    reader_ = std::thread([this] { Read(); });
+    writer_ = std::thread([this] { Write(); });
+  }
+
+  ~CoordinatorClient() override { Close(); }
+
+  void Close() {
+    {
+      std::lock_guard lock(mutex_);
+      if (fd_ < 0) {
+        return;
+      }
+      closed_ = true;
+    }
+    writer_cv_.notify_all();
+    writer_.join();
+    shutdown(fd_, SHUT_RDWR);
+    reader_.join();
+    close(fd_);
+    fd_ = -1;
+    cv_.notify_all();
+  }
+
+  SyncPoint::ProcessStatus Wait(const std::string& point, const std::chrono::steady_clock::time_point* deadline,
+                                const std::atomic<bool>* cancelled) override {
+    auto iter = remote_predecessors_.find(point);
+    if (iter == remote_predecessors_.end()) {
+      return SyncPoint::ProcessStatus::kReleased;
+    }
+    std::unique_lock lock(mutex_);
+    if (closed_) {
+      return SyncPoint::ProcessStatus::kTimedOut;
+    }
+    std::vector<uint64_t> ids;
+    for (const auto& pred : iter->second) {
+      ids.push_back(next_id_++);
+      pending_ += "W " + std::to_string(ids.back()) + " " + pred + "\n";
+    }
+    writer_cv_.notify_one();
+    auto status = SyncPoint::ProcessStatus::kReleased;
+    auto all_done = [&] {
+      return std::all_of(ids.begin(), ids.end(), [&](uint64_t id) { return done_.count(id) > 0; });
+    };
+    // cancellation is not signalled on cv_, so it is polled
+    constexpr auto kPollInterval = std::chrono::milliseconds(50);
+    while (!all_done()) {
+      if (closed_) {
+        status = SyncPoint::ProcessStatus::kTimedOut;
+        break;
+      }
+      if (cancelled != nullptr && *cancelled) {
+        status = SyncPoint::ProcessStatus::kCancelled;
+        break;
+      }
+      auto until = std::chrono::steady_clock::now() + kPollInterval;
+      if (deadline != nullptr && *deadline < until) {
+        if (cv_.wait_until(lock, *deadline) == std::cv_status::timeout && !all_done()) {
+          status = SyncPoint::ProcessStatus::kTimedOut;
+          break;
+        }
+      } else {
+        cv_.wait_until(lock, until);
+      }
+    }
+    for (uint64_t id : ids) {
+      done_.erase(id);
+    }
+    return status;
+  }
+
+  void Cleared(const std::string& point) override {
+    if (reported_.count(point) == 0) {
+      return;
+    }
+    std::lock_guard lock(mutex_);
+    pending_ += "C " + point + "\n";
+    writer_cv_.notify_one();
+  }
+
+ private:
+  // Writes whatever accumulated while the previous write was in flight.
+  void Write() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+      writer_cv_.wait(lock, [this] { return closed_ || !pending_.empty(); });
+      if (pending_.empty()) {
+        return;
+      }
+      auto batch = std::exchange(pending_, {});
+      lock.unlock();
+      bool written = WriteAll(fd_, batch);
+      lock.lock();
+      if (!written) {
+        closed_ = true;
+        cv_.notify_all();
+        return;
+      }
+    }
+  }
+
+  void Read() {
+    std::string in;
+    char buf[4096];
+    while (true) {
+      ssize_t ret = recv(fd_, buf, sizeof(buf), 0);
+      if (ret < 0 && errno == EINTR) {
+        continue;
+      }
+      if (ret <= 0) {
+        break;
+      }
+      in.append(buf, static_cast<size_t>(ret));
+      std::lock_guard lock(mutex_);
+      size_t begin = 0;
+      for (size_t end; (end = in.find('\n', begin)) != std::string::npos; begin = end + 1) {
+        if (in.compare(begin, 2, "D ") == 0) {
+          done_.insert(std::stoull(in.substr(begin + 2, end - begin - 2)));
+        }
+      }
+      in.erase(0, begin);
+      cv_.notify_all();
+    }
+    std::lock_guard lock(mutex_);
+    closed_ = true;
+    cv_.notify_all();
+    writer_cv_.notify_all();
+  }
+};
+
+std::mutex clients_mutex;
+// Process may still be inside a disconnected client, so clients are only
+// closed, never destroyed.
+std::vector<std::unique_ptr<CoordinatorClient>> clients;
+
+}  // namespace
+
+bool ConnectCoordinator(const std::string& address, const std::vector<std::string>& local_points,
+                        const std::vector<SyncPoint::SyncPointPair>& dependencies, std::string* report) {
+  // loading the whole graph first rejects cycles that cross nodes
+  if (!SyncPoint::GetInstance()->LoadDependencyAndMarkers(dependencies, {}, report)) {
+    return false;
+  }
+  std::unordered_set<std::string> local(local_points.begin(), local_points.end());
+  std::vector<SyncPoint::SyncPointPair> local_dependencies;
+  std::unordered_map<std::string, std::vector<std::string>> remote_predecessors;
+  std::unordered_set<std::string> reported;
+  for (const auto& dependency : dependencies) {
+    bool local_predecessor = local.count(dependency.predecessor) > 0;
+    bool local_successor = local.count(dependency.successor) > 0;
+    if (local_predecessor && local_successor) {
+      local_dependencies.push_back(dependency);
+    } else if (local_successor) {
+      remote_predecessors[dependency.successor].push_back(dependency.predecessor);
+    } else if (local_predecessor) {
+      reported.insert(dependency.predecessor);
+    }
+  }
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers(local_dependencies);
+
+  std::string error;
+  int fd = OpenSocket(address, false, &error);
+  if (fd < 0) {
+    if (report != nullptr) {
+      *report = std::move(error);
+    }
+    return false;
+  }
+  DisconnectCoordinator();
+  std::lock_guard lock(clients_mutex);
+  clients.push_back(std::make_unique<CoordinatorClient>(fd, std::move(remote_predecessors), std::move(reported)));
+  SyncPoint::GetInstance()->SetRemote(clients.back().get());
+  return true;
+}
+
+void DisconnectCoordinator() {
+  std::lock_guard lock(clients_mutex);
+  SyncPoint::GetInstance()->SetRemote(nullptr);
+  if (!clients.empty()) {
+    clients.back()->Close();
+  }
+}
+#endif  // UNIT_TEST
+
+}  // namespace utils
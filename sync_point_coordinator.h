@@ -0,0 +1,62 @@
+// Cross-process and cross-host sync points through a coordinator, companion
+// of sync_point.h.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "sync_point.h"
+
+namespace utils {
+
+// The coordinator records which points have been processed on any node and
+// answers waits for them. Nodes connect over a Unix domain socket (an
+// address starting with '/') or TCP ("host:port"). It can run inside a test
+// process as a stand-in, or as the sync_point_coordinator daemon.
+//
+// Protocol, one request or reply per line, any number per write:
+//   "C <point>"     the point was processed
+//   "W <id> <point>" reply "D <id>" once the point has been processed
+class SyncPointCoordinator {
+ public:
+  SyncPointCoordinator();
+  ~SyncPointCoordinator();
+
+  SyncPointCoordinator(const SyncPointCoordinator&) = delete;
+  SyncPointCoordinator& operator=(const SyncPointCoordinator&) = delete;
+
+  // start serving on `address`; TCP port 0 picks a free port
+  bool Start(const std::string& address, std::string* report = nullptr);
+
+  // stop serving, dropping every connection
+  void Stop();
+
+  // the address being served, with the actual TCP port
+  std::string Address() const;
+
+  // forget every processed point, e.g. between test cases
+  void Reset();
+
+ private:
+  struct State;
+  std::unique_ptr<State> state_;
+};
+
+#ifdef UNIT_TEST
+// Connects this node to the coordinator at `address`. Every node loads the
+// same `dependencies`, and `local_points` names the points it runs. Edges
+// between two local points are loaded into the local graph and never touch
+// the network. For an edge crossing nodes, the local predecessor reports
+// itself once processed, and the local successor long-polls the coordinator
+// for the remote predecessor. Reports are batched by a writer thread.
+// Returns false, describing why in `report`, if the graph has a cycle or
+// the coordinator cannot be reached.
+bool ConnectCoordinator(const std::string& address, const std::vector<std::string>& local_points,
+                        const std::vector<SyncPoint::SyncPointPair>& dependencies, std::string* report = nullptr);
+
+// disconnect, releasing waiters for remote predecessors with kTimedOut
+void DisconnectCoordinator();
+#endif  // UNIT_TEST
+
+}  // namespace utils
@@ -0,0 +1,32 @@
+// Runs a SyncPointCoordinator until SIGINT or SIGTERM.
+
+#include <signal.h>
+#include <cstdio>
+#include <string>
+#include "sync_point_coordinator.h"
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <socket path | host:port>\n", argv[0]);
+    return 1;
+  }
+  // blocked before the serving thread starts, so only sigwait sees them
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  utils::SyncPointCoordinator coordinator;
+  std::string report;
+  if (!coordinator.Start(argv[1], &report)) {
+    fprintf(stderr, "%s\n", report.c_str());
+    return 1;
+  }
+  printf("serving on %s\n", coordinator.Address().c_str());
+  fflush(stdout);
+  int signal = 0;
+  sigwait(&signals, &signal);
+  coordinator.Stop();
+  return 0;
+}
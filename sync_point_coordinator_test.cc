@@ -0,0 +1,70 @@
+#include "sync_point_coordinator.h"
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "sync_point.h"
+
+// NOLINTNEXTLINE
+using namespace utils;
+
+/************************************************************************/
+/* SyncPointCoordinatorTest */
+/************************************************************************/
+class SyncPointCoordinatorTest : public testing::Test {};
+
+TEST_F(SyncPointCoordinatorTest, TwoNodes) {
+  SyncPointCoordinator coordinator;
+  std::string report;
+  ASSERT_TRUE(coordinator.Start("127.0.0.1:0", &report)) << report;
+
+  // |    Node A     |    Node B     |
+  // |  A:Local1     |               |
+  // |  A:1          |               |
+  // |               |  B:2          |
+  // |  A:Local2     |               |
+  // |  A:3          |               |
+  std::vector<SyncPoint::SyncPointPair> dependencies = {
+      {"SyncPointCoordinatorTest::A:Local1", "SyncPointCoordinatorTest::A:1"},
+      {"SyncPointCoordinatorTest::A:1", "SyncPointCoordinatorTest::B:2"},
+      {"SyncPointCoordinatorTest::B:2", "SyncPointCoordinatorTest::A:3"},
+      {"SyncPointCoordinatorTest::A:Local2", "SyncPointCoordinatorTest::A:3"}};
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) {
+    bool connected = ConnectCoordinator(coordinator.Address(), {"SyncPointCoordinatorTest::B:2"}, dependencies);
+    TEST_SYNC_POINT("SyncPointCoordinatorTest::B:2");
+    DisconnectCoordinator();
+    _exit(connected ? 0 : 1);
+  }
+  ASSERT_TRUE(ConnectCoordinator(coordinator.Address(),
+                                 {"SyncPointCoordinatorTest::A:Local1", "SyncPointCoordinatorTest::A:1",
+                                  "SyncPointCoordinatorTest::A:Local2", "SyncPointCoordinatorTest::A:3"},
+                                 dependencies, &report))
+      << report;
+  // node B stays blocked on the remote predecessor
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  int status = 0;
+  ASSERT_EQ(waitpid(child, &status, WNOHANG), 0);
+  TEST_SYNC_POINT("SyncPointCoordinatorTest::A:Local1");
+  TEST_SYNC_POINT("SyncPointCoordinatorTest::A:1");
+  TEST_SYNC_POINT("SyncPointCoordinatorTest::A:Local2");
+  TEST_SYNC_POINT("SyncPointCoordinatorTest::A:3");
+  ASSERT_EQ(waitpid(child, &status, 0), child);
+  ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  // a remote predecessor nobody processes times out
+  coordinator.Reset();
+  ASSERT_EQ(SyncPoint::GetInstance()->ProcessFor("SyncPointCoordinatorTest::A:3", std::chrono::milliseconds(50)),
+            SyncPoint::ProcessStatus::kTimedOut);
+
+  DisconnectCoordinator();
+  coordinator.Stop();
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  SyncPoint::GetInstance()->ClearTrace();
+}
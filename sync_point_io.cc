@@ -0,0 +1,117 @@
+#include "sync_point_io.h"
+#include <atomic>
+#include <cerrno>
+#include <vector>
+#include "sync_point.h"
+
+#ifdef UNIT_TEST
+namespace utils {
+
+namespace {
+
+// number of threads inside an armed window, checked before anything else
+std::atomic<int> armed_threads = 0;
+
+// whether the calling thread is inside an armed window; a thread exiting
+// before its end point leaves the window on destruction
+struct ThreadArmed {
+  bool armed = false;
+
+  ~ThreadArmed() {
+    if (armed) {
+      armed_threads--;
+    }
+  }
+};
+
+thread_local ThreadArmed thread_armed;
+thread_local IOFault thread_fault;
+
+// Applies the calling thread's fault to `operation`. Returns true with
+// `*result` set if the call must fail, and may shorten `*count`.
+bool InjectFault(IOOperation operation, size_t* count, ssize_t* result) {
+  if (!thread_armed.armed || (thread_fault.operations & operation) == 0) {
+    return false;
+  }
+  if (thread_fault.latency.count() > 0) {
+    std::this_thread::sleep_for(thread_fault.latency);
+  }
+  if (thread_fault.error != 0) {
+    errno = thread_fault.error;
+    *result = -1;
+    return true;
+  }
+  if (count != nullptr && *count > thread_fault.max_bytes) {
+    *count = thread_fault.max_bytes;
+  }
+  return false;
+}
+
+}  // namespace
+
+std::pair<SyncPoint::CallbackHandle, SyncPoint::CallbackHandle> SetIOFault(const std::string& begin_point,
+                                                                           const std::string& end_point,
+                                                                           const IOFault& fault,
+                                                                           std::thread::id thread) {
+  auto begin = SyncPoint::GetInstance()->AddCallBack(begin_point, [fault, thread](const std::vector<void*>&) {
+    if (thread != std::thread::id() && thread != std::this_thread::get_id()) {
+      return;
+    }
+    if (!thread_armed.armed) {
+      thread_armed.armed = true;
+      armed_threads++;
+    }
+    thread_fault = fault;
+  });
+  auto end = SyncPoint::GetInstance()->AddCallBack(end_point, [](const std::vector<void*>&) {
+    if (thread_armed.armed) {
+      thread_armed.armed = false;
+      armed_threads--;
+    }
+  });
+  return {begin, end};
+}
+
+int SyncPointOpen(const char* path, int flags, mode_t mode) {
+  if (__builtin_expect(armed_threads.load(std::memory_order_relaxed) != 0, 0)) {
+    ssize_t result = 0;
+    if (InjectFault(kIOOpen, nullptr, &result)) {
+      return static_cast<int>(result);
+    }
+  }
+  return ::open(path, flags, mode);
+}
+
+ssize_t SyncPointPread(int fd, void* buf, size_t count, off_t offset) {
+  if (__builtin_expect(armed_threads.load(std::memory_order_relaxed) != 0, 0)) {
+    ssize_t result = 0;
+    if (InjectFault(kIOPread, &count, &result)) {
+      return result;
+    }
+  }
+  return ::pread(fd, buf, count, offset);
+}
+
+ssize_t SyncPointPwrite(int fd, const void* buf, size_t count, off_t offset) {
+  if (__builtin_expect(armed_threads.load(std::memory_order_relaxed) != 0, 0)) {
+    ssize_t result = 0;
+    if (InjectFault(kIOPwrite, &count, &result)) {
+      return result;
+    }
+  }
+  return ::pwrite(fd, buf, count, offset);
+}
+
+int SyncPointFsync(int fd) {
+  if (__builtin_expect(armed_threads.load(std::memory_order_relaxed) != 0, 0)) {
+    ssize_t result = 0;
+    if (InjectFault(kIOFsync, nullptr, &result)) {
+      return static_cast<int>(result);
+    }
+  }
+  return ::fsync(fd);
+}
+
+}  // namespace utils
+
+#endif  // UNIT_TEST
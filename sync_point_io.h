@@ -0,0 +1,64 @@
+// I/O fault injection keyed to sync points, companion of sync_point.h.
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <utility>
+#include "sync_point.h"
+
+namespace utils {
+
+// operations an IOFault applies to, as a bit mask
+enum IOOperation : unsigned {
+  kIOOpen = 1U << 0,
+  kIOPread = 1U << 1,
+  kIOPwrite = 1U << 2,
+  kIOFsync = 1U << 3,
+  kIOAll = kIOOpen | kIOPread | kIOPwrite | kIOFsync,
+};
+
+struct IOFault {
+  unsigned operations = kIOAll;
+  // delay added before each matching call
+  std::chrono::microseconds latency{0};
+  // fail matching calls with this errno, e.g. EIO or ENOSPC; 0 to let them run
+  int error = 0;
+  // reads and writes transfer at most this many bytes, for short I/O
+  size_t max_bytes = SIZE_MAX;
+};
+
+#ifdef UNIT_TEST
+// Once `begin_point` is processed on a thread (only on `thread`, if given),
+// the wrappers below apply `fault` to that thread's calls until `end_point`
+// is processed or the thread exits. Adds a callback to both points and
+// returns their handles, begin first, for SyncPoint::RemoveCallBack.
+std::pair<SyncPoint::CallbackHandle, SyncPoint::CallbackHandle> SetIOFault(const std::string& begin_point,
+                                                                           const std::string& end_point,
+                                                                           const IOFault& fault,
+                                                                           std::thread::id thread = {});
+
+// Drop-in wrappers for open, pread, pwrite and fsync. While no thread is
+// armed they cost one predicted branch over the system call.
+int SyncPointOpen(const char* path, int flags, mode_t mode = 0);
+ssize_t SyncPointPread(int fd, void* buf, size_t count, off_t offset);
+ssize_t SyncPointPwrite(int fd, const void* buf, size_t count, off_t offset);
+int SyncPointFsync(int fd);
+#else
+inline int SyncPointOpen(const char* path, int flags, mode_t mode = 0) { return ::open(path, flags, mode); }
+inline ssize_t SyncPointPread(int fd, void* buf, size_t count, off_t offset) {
+  return ::pread(fd, buf, count, offset);
+}
+inline ssize_t SyncPointPwrite(int fd, const void* buf, size_t count, off_t offset) {
+  return ::pwrite(fd, buf, count, offset);
+}
+inline int SyncPointFsync(int fd) { return ::fsync(fd); }
+#endif  // UNIT_TEST
+
+}  // namespace utils
@@ -0,0 +1,79 @@
+#include "sync_point_io.h"
+#include <gtest/gtest.h>
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sync_point.h"
+
+// NOLINTNEXTLINE
+using namespace utils;
+
+/************************************************************************/
+/* SyncPointIOTest */
+/************************************************************************/
+class SyncPointIOTest : public testing::Test {};
+
+TEST_F(SyncPointIOTest, Fault) {
+  char path[] = "/tmp/sync_point_io_test.XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  IOFault no_space;
+  no_space.operations = kIOPwrite | kIOFsync;
+  no_space.error = ENOSPC;
+  // the fault is added next to existing callbacks
+  int begin_hits = 0;
+  SyncPoint::GetInstance()->AddCallBack("SyncPointIOTest::Fault:Begin",
+                                        [&](const std::vector<void*>&) { begin_hits++; });
+  auto handles = SetIOFault("SyncPointIOTest::Fault:Begin", "SyncPointIOTest::Fault:End", no_space);
+  ASSERT_EQ(SyncPointPwrite(fd, "abcd", 4, 0), 4);
+  TEST_SYNC_POINT("SyncPointIOTest::Fault:Begin");
+  ASSERT_EQ(SyncPointPwrite(fd, "abcd", 4, 0), -1);
+  ASSERT_EQ(errno, ENOSPC);
+  ASSERT_EQ(SyncPointFsync(fd), -1);
+  char buf[4];
+  ASSERT_EQ(SyncPointPread(fd, buf, 4, 0), 4);
+  // other threads are not armed
+  std::thread([&]() { ASSERT_EQ(SyncPointPwrite(fd, "abcd", 4, 0), 4); }).join();
+  TEST_SYNC_POINT("SyncPointIOTest::Fault:End");
+  ASSERT_EQ(SyncPointPwrite(fd, "abcd", 4, 0), 4);
+  ASSERT_EQ(SyncPointFsync(fd), 0);
+  ASSERT_EQ(begin_hits, 1);
+
+  // and removed by handle
+  SyncPoint::GetInstance()->RemoveCallBack(handles.first);
+  SyncPoint::GetInstance()->RemoveCallBack(handles.second);
+  TEST_SYNC_POINT("SyncPointIOTest::Fault:Begin");
+  ASSERT_EQ(SyncPointPwrite(fd, "abcd", 4, 0), 4);
+  TEST_SYNC_POINT("SyncPointIOTest::Fault:End");
+
+  IOFault short_read;
+  short_read.operations = kIOPread;
+  short_read.max_bytes = 1;
+  handles = SetIOFault("SyncPointIOTest::Fault:Begin", "SyncPointIOTest::Fault:End", short_read);
+  TEST_SYNC_POINT("SyncPointIOTest::Fault:Begin");
+  ASSERT_EQ(SyncPointPread(fd, buf, 4, 0), 1);
+  TEST_SYNC_POINT("SyncPointIOTest::Fault:End");
+  SyncPoint::GetInstance()->RemoveCallBack(handles.first);
+  SyncPoint::GetInstance()->RemoveCallBack(handles.second);
+
+  IOFault eio;
+  eio.operations = kIOOpen;
+  eio.error = EIO;
+  handles = SetIOFault("SyncPointIOTest::Fault:Begin", "SyncPointIOTest::Fault:End", eio);
+  TEST_SYNC_POINT("SyncPointIOTest::Fault:Begin");
+  ASSERT_EQ(SyncPointOpen(path, O_RDONLY), -1);
+  ASSERT_EQ(errno, EIO);
+  TEST_SYNC_POINT("SyncPointIOTest::Fault:End");
+  int reopened = SyncPointOpen(path, O_RDONLY);
+  ASSERT_GE(reopened, 0);
+
+  close(reopened);
+  close(fd);
+  unlink(path);
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+}
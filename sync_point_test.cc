@@ -1,9 +1,21 @@
 #include "sync_point.h"
 #include <gtest/gtest.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <new>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -30,6 +42,11 @@ void DummyPlusOneSyncPoint(int& num) {
   return;
 }
 
+// the point name is evaluated once
+void DummyIdxReturnSyncPoint(int& index) {
+  TEST_SYNC_POINT_RETURN_VOID("SyncPointTest::DummyIdxReturnSyncPoint:" + std::to_string(index++));
+}
+
 std::string DummyReturnHelloSyncPoint() {
   std::string str = "Hello";
   TEST_SYNC_POINT_RETURN_VALUE("SyncPointTest::DummyReturnHelloSyncPoint", &str);
@@ -214,15 +231,49 @@ TEST_F(SyncPointTest, DependencyAndMark2) {
   SyncPoint::GetInstance()->DisableProcessing();
 }
 
+// the task id an executor would keep for its running task
+namespace {
+
+thread_local uint64_t current_task = 0;
+
+}  // namespace
+
+TEST_F(SyncPointTest, DependencyAndMarkLogicalThread) {
+  std::atomic<int> sync_point_called(0);
+  SyncPoint::GetInstance()->SetCallBack("SyncPointTest::MarkedPoint",
+                                        [&](const std::vector<void*>& /*args*/) { sync_point_called.fetch_add(1); });
+  SyncPoint::GetInstance()->SetContextProvider([] { return current_task; });
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {}, {{"SyncPointTest::DependencyAndMarkLogicalThread:Marker", "SyncPointTest::MarkedPoint"}});
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  // task 1 hits the marker on one OS thread and resumes on another, while
+  // task 2 shares the first OS thread
+  std::thread([&]() {
+    current_task = 1;
+    TEST_SYNC_POINT("SyncPointTest::DependencyAndMarkLogicalThread:Marker");
+    current_task = 2;
+    CountSyncPoint();
+  }).join();
+  std::thread([&]() {
+    current_task = 1;
+    CountSyncPoint();
+  }).join();
+  ASSERT_EQ(sync_point_called.load(), 1);
+
+  SyncPoint::GetInstance()->SetContextProvider(nullptr);
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  SyncPoint::GetInstance()->ClearTrace();
+}
+
 TEST_F(SyncPointTest, Return) {
   {
     int num = 12;
     DummyPlusOneSyncPoint(num);
     ASSERT_EQ(num, 13);
-    SyncPoint::GetInstance()->SetCallBack("SyncPointTest::DummyPlusOneSyncPoint", [&](const std::vector<void*>& args) {
-      bool* flag = (bool*)args[0];
-      *flag = true;
-    });
+    SyncPoint::GetInstance()->SetCallBack("SyncPointTest::DummyPlusOneSyncPoint",
+                                          [&](const std::vector<void*>&) { return SyncPoint::Action::kReturn; });
     SyncPoint::GetInstance()->EnableProcessing();
     DummyPlusOneSyncPoint(num);
     ASSERT_EQ(num, 13);
@@ -233,13 +284,1140 @@ TEST_F(SyncPointTest, Return) {
     SyncPoint::GetInstance()->SetCallBack(           //
         "SyncPointTest::DummyReturnHelloSyncPoint",  //
         [&](const std::vector<void*>& args) {
-          bool* flag = (bool*)args[0];
-          auto str = (std::string*)args[1];
-          *flag = true;
+          auto str = (std::string*)args[0];
           *str = "Word";
+          return SyncPoint::Action::kReturn;
         });
     SyncPoint::GetInstance()->EnableProcessing();
     ASSERT_EQ(DummyReturnHelloSyncPoint(), "Word");
     SyncPoint::GetInstance()->DisableProcessing();
   }
+  {
+    int num = 12;
+    SyncPoint::GetInstance()->SetCallBack("SyncPointTest::DummyPlusOneSyncPoint",
+                                          [&](const std::vector<void*>&) { return SyncPoint::Action::kThrow; });
+    SyncPoint::GetInstance()->EnableProcessing();
+    ASSERT_THROW(DummyPlusOneSyncPoint(num), SyncPoint::InjectedFault);
+    ASSERT_EQ(num, 12);
+    // an action ends the chain, and plain TEST_SYNC_POINT continues
+    SyncPoint::GetInstance()->AddCallBack("SyncPointTest::DummyPlusOneSyncPoint",
+                                          [&](const std::vector<void*>&) { num = 0; });
+    ASSERT_EQ(TEST_SYNC_POINT("SyncPointTest::DummyPlusOneSyncPoint"), SyncPoint::Action::kThrow);
+    ASSERT_EQ(num, 12);
+    SyncPoint::GetInstance()->SetCallBack("SyncPointTest::DummyIdxReturnSyncPoint:0",
+                                          [&](const std::vector<void*>&) { return SyncPoint::Action::kThrow; });
+    int index = 0;
+    try {
+      DummyIdxReturnSyncPoint(index);
+      FAIL();
+    } catch (const SyncPoint::InjectedFault& fault) {
+      ASSERT_STREQ(fault.what(), "fault injected at SyncPointTest::DummyIdxReturnSyncPoint:0");
+    }
+    ASSERT_EQ(index, 1);
+    ASSERT_DEATH(
+        {
+          SyncPoint::GetInstance()->SetCallBack("SyncPointTest::DummyPlusOneSyncPoint",
+                                                [&](const std::vector<void*>&) { return SyncPoint::Action::kAbort; });
+          DummyPlusOneSyncPoint(num);
+        },
+        "abort injected");
+    SyncPoint::GetInstance()->DisableProcessing();
+    SyncPoint::GetInstance()->ClearAllCallBacks();
+  }
+}
+
+TEST_F(SyncPointTest, DependencySpec) {
+  using Pairs = std::vector<std::pair<std::string, std::string>>;
+  auto pairs = [](const std::vector<SyncPoint::SyncPointPair>& edges) {
+    Pairs result;
+    for (const auto& edge : edges) {
+      result.emplace_back(edge.predecessor, edge.successor);
+    }
+    return result;
+  };
+  std::vector<SyncPoint::SyncPointPair> dependencies;
+  std::vector<SyncPoint::SyncPointPair> markers;
+  ASSERT_TRUE(SyncPoint::ParseDependencies("A -> B->C; D -> C  # comment\n"
+                                           "marker X => Y\n"
+                                           "\"With space\" -> Z::1",
+                                           &dependencies, &markers));
+  ASSERT_EQ(pairs(dependencies), (Pairs{{"A", "B"}, {"B", "C"}, {"D", "C"}, {"With space", "Z::1"}}));
+  ASSERT_EQ(pairs(markers), (Pairs{{"X", "Y"}}));
+
+  // JSON, and the formatted spec, parse to the same graph
+  std::vector<SyncPoint::SyncPointPair> json_dependencies;
+  std::vector<SyncPoint::SyncPointPair> json_markers;
+  ASSERT_TRUE(SyncPoint::ParseDependencies(
+      R"({"dependencies": [["A", "B", "C"], ["D", "C"], ["With space", "Z::1"]], "markers": [["X", "Y"]]})",
+      &json_dependencies, &json_markers));
+  ASSERT_EQ(pairs(json_dependencies), pairs(dependencies));
+  ASSERT_EQ(pairs(json_markers), pairs(markers));
+  ASSERT_TRUE(SyncPoint::ParseDependencies(SyncPoint::FormatDependencies(dependencies, markers), &json_dependencies,
+                                           &json_markers));
+  ASSERT_EQ(pairs(json_dependencies), pairs(dependencies));
+  ASSERT_EQ(pairs(json_markers), pairs(markers));
+
+  // names the DSL would read as syntax round-trip through FormatDependencies
+  Pairs awkward{{"marker", "{A}"}, {"", "a -> b"}, {"x\"y\\z", "tab\there"}, {"c # d", "e;f\n"}, {"g=>h", "marker"}};
+  dependencies.clear();
+  for (const auto& [predecessor, successor] : awkward) {
+    dependencies.push_back({predecessor, successor});
+  }
+  ASSERT_TRUE(SyncPoint::ParseDependencies(SyncPoint::FormatDependencies(dependencies, {{"marker", "{B"}}),
+                                           &json_dependencies, &json_markers));
+  ASSERT_EQ(pairs(json_dependencies), awkward);
+  ASSERT_EQ(pairs(json_markers), (Pairs{{"marker", "{B"}}));
+
+  std::string report;
+  ASSERT_FALSE(SyncPoint::ParseDependencies("A -> B\nC D", &dependencies, &markers, &report));
+  ASSERT_EQ(report, "2:3: expected '->' or '=>'");
+  ASSERT_FALSE(SyncPoint::ParseDependencies(R"({"dependencies": [["A"]]})", &dependencies, &markers, &report));
+  ASSERT_EQ(report, "1:24: a chain needs at least two points");
+  ASSERT_TRUE(SyncPoint::ParseDependencies(R"("\u0041\u00e9" -> B)", &dependencies, &markers));
+  ASSERT_EQ(dependencies[0].predecessor, "A\xc3\xa9");
+  ASSERT_FALSE(SyncPoint::ParseDependencies(R"("\u41 x" -> B)", &dependencies, &markers, &report));
+
+  // a generated chain of 100k edges
+  std::string chain = "P0";
+  for (int i = 1; i <= 100000; ++i) {
+    chain += " -> P" + std::to_string(i);
+  }
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_TRUE(SyncPoint::ParseDependencies(chain, &dependencies, &markers));
+  ASSERT_EQ(dependencies.size(), 100000);
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+
+  // loading from a file named by an environment variable
+  const char* path = "/tmp/sync_point_test_spec.txt";
+  std::ofstream(path) << "SyncPointTest::Spec:1 -> SyncPointTest::Spec:2\n";
+  setenv("SYNC_POINT_TEST_SPEC", "@/tmp/sync_point_test_spec.txt", 1);
+  ASSERT_TRUE(SyncPoint::GetInstance()->LoadDependencyFromEnv("SYNC_POINT_TEST_SPEC", &report)) << report;
+  SyncPoint::GetInstance()->EnableProcessing();
+  std::string order;
+  std::thread thread([&]() {
+    TEST_SYNC_POINT("SyncPointTest::Spec:2");
+    order += "2";
+  });
+  order += "1";
+  TEST_SYNC_POINT("SyncPointTest::Spec:1");
+  thread.join();
+  ASSERT_EQ(order, "12");
+  unsetenv("SYNC_POINT_TEST_SPEC");
+  unlink(path);
+
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  SyncPoint::GetInstance()->ClearTrace();
+}
+
+TEST_F(SyncPointTest, Pattern) {
+  std::mutex mutex;
+  std::vector<std::string> hits;
+  auto record = [&](const std::string& name) {
+    return [&, name](const std::vector<void*>&) {
+      std::lock_guard lock(mutex);
+      hits.push_back(name);
+    };
+  };
+  SyncPoint::GetInstance()->EnableProcessing();
+  TEST_SYNC_POINT("SyncPointTest::Pattern:Seen");
+  SyncPoint::GetInstance()->SetCallBack("SyncPointTest::Pattern:*", record("any"));
+  SyncPoint::GetInstance()->SetCallBack("SyncPointTest::Pattern:1?", record("1?"));
+  SyncPoint::GetInstance()->SetCallBack("SyncPointTest::Pattern:12", record("12"));
+  for (int i : {3, 12, 13, 123}) {
+    TEST_IDX_SYNC_POINT("SyncPointTest::Pattern:", i);
+  }
+  TEST_SYNC_POINT("SyncPointTest::Pattern:Seen");
+  TEST_SYNC_POINT("SyncPointTest::Other");
+  ASSERT_EQ(hits, (std::vector<std::string>{"any", "12", "1?", "any", "any"}));
+
+  // a cached point is re-resolved when its pattern goes away
+  SyncPoint::GetInstance()->ClearCallBack("SyncPointTest::Pattern:1?");
+  hits.clear();
+  TEST_IDX_SYNC_POINT("SyncPointTest::Pattern:", 13);
+  ASSERT_EQ(hits, (std::vector<std::string>{"any"}));
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+
+  // every worker waits for the gate
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {{"SyncPointTest::Pattern:Gate", "SyncPointTest::Pattern:Worker*"}});
+  std::atomic<int> passed = 0;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 3; ++i) {
+    threads.emplace_back([&, i]() {
+      TEST_IDX_SYNC_POINT("SyncPointTest::Pattern:Worker", i);
+      passed++;
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_EQ(passed, 0);
+  TEST_SYNC_POINT("SyncPointTest::Pattern:Gate");
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(passed, 3);
+
+  // a cycle through the points a pattern matches
+  std::string report;
+  ASSERT_FALSE(SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {
+          {"SyncPointTest::Pattern:B", "SyncPointTest::Pattern:A*"},
+          {"SyncPointTest::Pattern:A1", "SyncPointTest::Pattern:B"},
+      },
+      {}, &report));
+  ASSERT_NE(report.find("SyncPointTest::Pattern:A*"), std::string::npos) << report;
+
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  SyncPoint::GetInstance()->ClearTrace();
+}
+
+TEST_F(SyncPointTest, CallbackChain) {
+  std::string order;
+  auto* sync_point = SyncPoint::GetInstance();
+  sync_point->EnableProcessing();
+  sync_point->AddCallBack("SyncPointTest::Chain", [&](const std::vector<void*>&) { order += "a"; });
+  auto b = sync_point->AddCallBack("SyncPointTest::Chain", [&](const std::vector<void*>&) { order += "b"; }, 10);
+  sync_point->AddCallBack("SyncPointTest::Chain", [&](const std::vector<void*>&) { order += "c"; });
+  TEST_SYNC_POINT("SyncPointTest::Chain");
+  ASSERT_EQ(order, "bac");
+
+  // a callback returning false ends the chain
+  order.clear();
+  auto stop = sync_point->AddCallBack(
+      "SyncPointTest::Chain",
+      [&](const std::vector<void*>&) {
+        order += "s";
+        return false;
+      },
+      5);
+  TEST_SYNC_POINT("SyncPointTest::Chain");
+  ASSERT_EQ(order, "bs");
+  ASSERT_TRUE(sync_point->RemoveCallBack(stop));
+  ASSERT_TRUE(sync_point->RemoveCallBack(b));
+  ASSERT_FALSE(sync_point->RemoveCallBack(b));
+  order.clear();
+  TEST_SYNC_POINT("SyncPointTest::Chain");
+  ASSERT_EQ(order, "ac");
+
+  // a fault joins the chain, and replaces only the previous fault
+  SyncPoint::FaultSpec spec;
+  spec.every_k_hits = 1;
+  sync_point->SetFault("SyncPointTest::Chain", spec);
+  sync_point->SetFault("SyncPointTest::Chain", spec);
+  order.clear();
+  ASSERT_EQ(TEST_SYNC_POINT("SyncPointTest::Chain"), SyncPoint::Action::kReturn);
+  ASSERT_EQ(order, "ac");
+  ASSERT_EQ(sync_point->GetFaultStats("SyncPointTest::Chain").hits, 1);
+
+  // SetCallBack replaces the whole chain
+  sync_point->SetCallBack("SyncPointTest::Chain", [&](const std::vector<void*>&) { order += "x"; });
+  order.clear();
+  ASSERT_EQ(TEST_SYNC_POINT("SyncPointTest::Chain"), SyncPoint::Action::kContinue);
+  ASSERT_EQ(order, "x");
+
+  sync_point->DisableProcessing();
+  sync_point->ClearAllCallBacks();
+  sync_point->ClearTrace();
+}
+
+TEST_F(SyncPointTest, CallbackFilter) {
+  auto* sync_point = SyncPoint::GetInstance();
+  std::atomic<int> count = 0;
+  auto counter = [&](const std::vector<void*>&) { count++; };
+  sync_point->SetCallBack("SyncPointTest::Filter:Shard", SyncPoint::CallbackFilter().ArgEqual(0, 7), counter);
+  sync_point->EnableProcessing();
+  for (int i = 0; i < 10000; ++i) {
+    int shard = i % 100;
+    TEST_SYNC_POINT_ARGS("SyncPointTest::Filter:Shard", &shard);
+  }
+  TEST_SYNC_POINT("SyncPointTest::Filter:Shard");
+  ASSERT_EQ(count, 100);
+
+  // a rejected hit still waits for its predecessor, and clears the point
+  sync_point->LoadDependencyAndMarkers({{"SyncPointTest::Filter:Before", "SyncPointTest::Filter:Shard"},
+                                        {"SyncPointTest::Filter:Shard", "SyncPointTest::Filter:After"}});
+  std::atomic<bool> passed = false;
+  std::thread waiter([&]() {
+    int other = 8;
+    TEST_SYNC_POINT_ARGS("SyncPointTest::Filter:Shard", &other);
+    passed = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_FALSE(passed);
+  TEST_SYNC_POINT("SyncPointTest::Filter:Before");
+  waiter.join();
+  TEST_SYNC_POINT("SyncPointTest::Filter:After");
+  ASSERT_EQ(count, 100);
+  sync_point->LoadDependencyAndMarkers({});
+
+  // only hits on the given threads
+  count = 0;
+  std::thread thread([&]() {
+    while (count == 0) {
+      TEST_SYNC_POINT("SyncPointTest::Filter:Thread:1");
+      std::this_thread::yield();
+    }
+  });
+  sync_point->SetCallBack("SyncPointTest::Filter:Thread:*", SyncPoint::CallbackFilter().OnThreads({thread.get_id()}),
+                          counter);
+  thread.join();
+  TEST_SYNC_POINT("SyncPointTest::Filter:Thread:1");
+  ASSERT_EQ(count, 1);
+
+  // setting the callback again drops the filter
+  sync_point->SetCallBack("SyncPointTest::Filter:Thread:*", counter);
+  TEST_SYNC_POINT("SyncPointTest::Filter:Thread:1");
+  ASSERT_EQ(count, 2);
+
+  sync_point->DisableProcessing();
+  sync_point->ClearAllCallBacks();
+  sync_point->ClearTrace();
+}
+
+TEST_F(SyncPointTest, DependencyCycle) {
+  std::string report;
+  ASSERT_FALSE(SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {
+          {"SyncPointTest::Cycle:A", "SyncPointTest::Cycle:B"},
+          {"SyncPointTest::Cycle:B", "SyncPointTest::Cycle:C"},
+          {"SyncPointTest::Cycle:C", "SyncPointTest::Cycle:A"},
+          {"SyncPointTest::Cycle:C", "SyncPointTest::Cycle:D"},
+      },
+      {}, &report));
+  ASSERT_NE(report.find("SyncPointTest::Cycle:A -> SyncPointTest::Cycle:B"), std::string::npos) << report;
+  ASSERT_EQ(report.find("SyncPointTest::Cycle:D"), std::string::npos) << report;
+
+  // The marker pair adds an implicit dependency which closes the cycle.
+  ASSERT_FALSE(SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {{"SyncPointTest::Cycle:B", "SyncPointTest::Cycle:A"}}, {{"SyncPointTest::Cycle:A", "SyncPointTest::Cycle:B"}},
+      &report));
+
+  // A long generated chain is sorted in linear time.
+  std::vector<SyncPoint::SyncPointPair> chain;
+  for (int i = 0; i < 100000; ++i) {
+    chain.push_back({"SyncPointTest::Chain:" + std::to_string(i), "SyncPointTest::Chain:" + std::to_string(i + 1)});
+  }
+  ASSERT_TRUE(SyncPoint::GetInstance()->LoadDependencyAndMarkers(chain));
+  chain.push_back({"SyncPointTest::Chain:100000", "SyncPointTest::Chain:0"});
+  ASSERT_FALSE(SyncPoint::GetInstance()->LoadDependencyAndMarkers(chain));
+
+  // A successor bound by two markers runs on the thread of the first one.
+  ASSERT_TRUE(SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {}, {{"SyncPointTest::Cycle:Marker1", "SyncPointTest::Cycle:Marked"},
+           {"SyncPointTest::Cycle:Marker2", "SyncPointTest::Cycle:Marked"}}));
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers({});
+}
+
+TEST_F(SyncPointTest, Watchdog) {
+  std::atomic<bool> callback_called = false;
+  SyncPoint::GetInstance()->SetCallBack("SyncPointTest::Watchdog:Stuck",
+                                        [&](const std::vector<void*>&) { callback_called = true; });
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers({
+      {"SyncPointTest::Watchdog:Never", "SyncPointTest::Watchdog:Stuck"},
+      {"SyncPointTest::Watchdog:Never", "SyncPointTest::Watchdog:Pattern*"},
+  });
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  testing::internal::CaptureStderr();
+  std::atomic<bool> returned = false;
+  std::thread thread([&]() {
+    TEST_SYNC_POINT("SyncPointTest::Watchdog:Stuck");
+    returned = true;
+  });
+  std::thread pattern_thread([]() { TEST_SYNC_POINT("SyncPointTest::Watchdog:Pattern:1"); });
+  std::string waiters;
+  while (std::count(waiters.begin(), waiters.end(), '\n') < 2) {
+    std::this_thread::yield();
+    waiters = SyncPoint::GetInstance()->DumpWaiters();
+  }
+  ASSERT_NE(waiters.find("\"SyncPointTest::Watchdog:Stuck\", waiting for: \"SyncPointTest::Watchdog:Never\""),
+            std::string::npos)
+      << waiters;
+  // predecessors of a matching pattern are listed too
+  ASSERT_NE(waiters.find("\"SyncPointTest::Watchdog:Pattern:1\", waiting for: \"SyncPointTest::Watchdog:Never\""),
+            std::string::npos)
+      << waiters;
+  ASSERT_FALSE(returned);
+
+  SyncPoint::GetInstance()->EnableWatchdog(std::chrono::milliseconds(10), SyncPoint::WatchdogAction::kRelease);
+  thread.join();
+  pattern_thread.join();
+  SyncPoint::GetInstance()->DisableWatchdog();
+  std::string report = testing::internal::GetCapturedStderr();
+
+  ASSERT_TRUE(returned);
+  ASSERT_FALSE(callback_called);
+  ASSERT_NE(report.find("SyncPointTest::Watchdog:Never"), std::string::npos) << report;
+  ASSERT_TRUE(SyncPoint::GetInstance()->DumpWaiters().empty());
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers({});
+}
+
+TEST_F(SyncPointTest, ProcessWithDeadline) {
+  using Status = SyncPoint::ProcessStatus;
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {
+          {"SyncPointTest::Deadline:Pred", "SyncPointTest::Deadline:Succ"},
+      },
+      {{"SyncPointTest::Deadline:Marker", "SyncPointTest::Deadline:Marked"}});
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  ASSERT_EQ(SyncPoint::GetInstance()->ProcessFor("SyncPointTest::Deadline:Succ", std::chrono::milliseconds(5)),
+            Status::kTimedOut);
+
+  std::atomic<bool> cancelled = false;
+  std::thread thread([&]() {
+    auto status = SyncPoint::GetInstance()->ProcessUntil(
+        "SyncPointTest::Deadline:Succ", std::chrono::steady_clock::now() + std::chrono::hours(1), {}, &cancelled);
+    ASSERT_EQ(status, Status::kCancelled);
+  });
+  while (SyncPoint::GetInstance()->DumpWaiters().empty()) {
+    std::this_thread::yield();
+  }
+  cancelled = true;
+  SyncPoint::GetInstance()->WakeWaiters();
+  thread.join();
+
+  thread = std::thread([]() {
+    auto status = SyncPoint::GetInstance()->ProcessFor("SyncPointTest::Deadline:Succ", std::chrono::hours(1));
+    ASSERT_EQ(status, Status::kReleased);
+  });
+  TEST_SYNC_POINT("SyncPointTest::Deadline:Pred");
+  thread.join();
+
+  TEST_SYNC_POINT("SyncPointTest::Deadline:Marker");
+  std::thread([]() {
+    auto status = SyncPoint::GetInstance()->ProcessFor("SyncPointTest::Deadline:Marked", std::chrono::hours(1));
+    ASSERT_EQ(status, Status::kDisabledByMarker);
+  }).join();
+  ASSERT_EQ(SyncPoint::GetInstance()->ProcessFor("SyncPointTest::Deadline:Marked", std::chrono::hours(1)),
+            Status::kReleased);
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers({});
+}
+
+TEST_F(SyncPointTest, GroupDependency) {
+  std::string report;
+  // C may run after B alone, so the edge back to A is not a deadlock.
+  ASSERT_TRUE(SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {{"SyncPointTest::Group:C", "SyncPointTest::Group:A"}}, {},
+      {{{"SyncPointTest::Group:A", "SyncPointTest::Group:B"}, "SyncPointTest::Group:C", 1}}, &report));
+  ASSERT_FALSE(SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {{"SyncPointTest::Group:C", "SyncPointTest::Group:A"}}, {},
+      {{{"SyncPointTest::Group:A", "SyncPointTest::Group:B"}, "SyncPointTest::Group:C", 2}}, &report));
+  ASSERT_NE(report.find("SyncPointTest::Group:A -> SyncPointTest::Group:C"), std::string::npos) << report;
+  ASSERT_FALSE(SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {}, {}, {{{"SyncPointTest::Group:A"}, "SyncPointTest::Group:C", 2}}, &report));
+
+  ASSERT_TRUE(SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {}, {},
+      {
+          {{"SyncPointTest::Group:Flush", "SyncPointTest::Group:Compaction"}, "SyncPointTest::Group:AnyOf"},
+          {{"SyncPointTest::Group:Q1", "SyncPointTest::Group:Q2", "SyncPointTest::Group:Q3"},
+           "SyncPointTest::Group:Quorum",
+           2},
+      }));
+  SyncPoint::GetInstance()->EnableProcessing();
+  using Status = SyncPoint::ProcessStatus;
+  auto probe = [](const std::string& point) {
+    return SyncPoint::GetInstance()->ProcessFor(point, std::chrono::milliseconds(1));
+  };
+
+  ASSERT_EQ(probe("SyncPointTest::Group:AnyOf"), Status::kTimedOut);
+  std::thread thread([]() { TEST_SYNC_POINT("SyncPointTest::Group:AnyOf"); });
+  TEST_SYNC_POINT("SyncPointTest::Group:Compaction");
+  thread.join();
+
+  TEST_SYNC_POINT("SyncPointTest::Group:Q2");
+  ASSERT_EQ(probe("SyncPointTest::Group:Quorum"), Status::kTimedOut);
+  TEST_SYNC_POINT("SyncPointTest::Group:Q3");
+  ASSERT_EQ(probe("SyncPointTest::Group:Quorum"), Status::kReleased);
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers({});
+}
+
+TEST_F(SyncPointTest, Rendezvous) {
+  constexpr int kThreads = 4;
+  SyncPoint::GetInstance()->SetBarrier("SyncPointTest::Rendezvous:Barrier", kThreads);
+  SyncPoint::GetInstance()->SetLatch("SyncPointTest::Rendezvous:Latch", kThreads);
+  SyncPoint::GetInstance()->SetSemaphore("SyncPointTest::Rendezvous:Acquire", "SyncPointTest::Rendezvous:Release", 2);
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  std::atomic<int> arrived = 0;
+  std::atomic<int> passed_early = 0;
+  std::atomic<int> inside = 0;
+  std::atomic<int> max_inside = 0;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back([&]() {
+      for (int round = 1; round <= 2; ++round) {
+        arrived++;
+        TEST_SYNC_POINT("SyncPointTest::Rendezvous:Barrier");
+        if (arrived < round * kThreads) {
+          passed_early++;
+        }
+        // wait until everyone has left the barrier before the next round
+        TEST_SYNC_POINT("SyncPointTest::Rendezvous:Barrier");
+      }
+      for (int j = 0; j < 10; ++j) {
+        TEST_SYNC_POINT("SyncPointTest::Rendezvous:Acquire");
+        int now = ++inside;
+        int max = max_inside;
+        while (now > max && !max_inside.compare_exchange_weak(max, now)) {
+        }
+        std::this_thread::yield();
+        inside--;
+        TEST_SYNC_POINT("SyncPointTest::Rendezvous:Release");
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(passed_early, 0);
+  ASSERT_LE(max_inside, 2);
+
+  using Status = SyncPoint::ProcessStatus;
+  auto probe = [](const std::string& point) {
+    return SyncPoint::GetInstance()->ProcessFor(point, std::chrono::milliseconds(1));
+  };
+  for (int i = 0; i < kThreads - 1; ++i) {
+    ASSERT_EQ(probe("SyncPointTest::Rendezvous:Latch"), Status::kTimedOut);
+  }
+  ASSERT_EQ(probe("SyncPointTest::Rendezvous:Latch"), Status::kReleased);
+  ASSERT_EQ(probe("SyncPointTest::Rendezvous:Latch"), Status::kReleased);
+
+  // a timed out waiter leaves the barrier
+  ASSERT_EQ(probe("SyncPointTest::Rendezvous:Barrier"), Status::kTimedOut);
+  SyncPoint::GetInstance()->SetBarrier("SyncPointTest::Rendezvous:Barrier", 1);
+  ASSERT_EQ(probe("SyncPointTest::Rendezvous:Barrier"), Status::kReleased);
+
+  // a count of 0 is ignored rather than blocking every arrival
+  SyncPoint::GetInstance()->SetBarrier("SyncPointTest::Rendezvous:Zero", 0);
+  SyncPoint::GetInstance()->SetSemaphore("SyncPointTest::Rendezvous:Zero", "SyncPointTest::Rendezvous:ZeroRelease", 0);
+  ASSERT_EQ(probe("SyncPointTest::Rendezvous:Zero"), Status::kReleased);
+  SyncPoint::GetInstance()->SetBarrier("SyncPointTest::Rendezvous:Barrier", 0);
+  ASSERT_EQ(probe("SyncPointTest::Rendezvous:Barrier"), Status::kReleased);
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearRendezvous();
+}
+
+TEST_F(SyncPointTest, StepController) {
+  constexpr int kThreads = 3;
+  std::mutex m;
+  std::string order;
+  SyncPoint::GetInstance()->HoldAt({"SyncPointTest::Step:Enter", "SyncPointTest::Step:Exit"});
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back([&, i]() {
+      TEST_SYNC_POINT("SyncPointTest::Step:Enter");
+      {
+        std::lock_guard lock(m);
+        order += std::to_string(i);
+      }
+      TEST_SYNC_POINT("SyncPointTest::Step:Exit");
+    });
+  }
+  ASSERT_TRUE(SyncPoint::GetInstance()->WaitForParked(kThreads, std::chrono::seconds(10)));
+  for (const auto& parked : SyncPoint::GetInstance()->ParkedThreads()) {
+    ASSERT_EQ(parked.point, "SyncPointTest::Step:Enter");
+  }
+
+  // step 2, then 0, then 1 through the critical section
+  for (int i : {2, 0, 1}) {
+    ASSERT_TRUE(SyncPoint::GetInstance()->Step(threads[i].get_id()));
+    ASSERT_FALSE(SyncPoint::GetInstance()->Step(std::this_thread::get_id()));
+    ASSERT_TRUE(SyncPoint::GetInstance()->WaitForParked(kThreads, std::chrono::seconds(10)));
+  }
+  {
+    std::lock_guard lock(m);
+    ASSERT_EQ(order, "201");
+  }
+  for (const auto& parked : SyncPoint::GetInstance()->ParkedThreads()) {
+    ASSERT_EQ(parked.point, "SyncPointTest::Step:Exit");
+  }
+  SyncPoint::GetInstance()->ClearHolds();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  SyncPoint::GetInstance()->DisableProcessing();
+}
+
+TEST_F(SyncPointTest, Explore) {
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  // an unsynchronised read-modify-write loses an update on some schedules
+  int counter = 0;
+  auto result = SyncPoint::GetInstance()->Explore(
+      2, [&]() { counter = 0; },
+      [&](size_t) {
+        int value = counter;
+        TEST_SYNC_POINT("SyncPointTest::Explore:Read");
+        counter = value + 1;
+        TEST_SYNC_POINT("SyncPointTest::Explore:Write");
+      },
+      [&]() { return counter == 2; });
+  ASSERT_TRUE(result.failed);
+  ASSERT_FALSE(result.deadlock);
+  ASSERT_GE(result.failing_schedule.size(), 2);
+
+  // with a mutex every schedule passes; count the schedules explored
+  std::mutex m;
+  auto locked_body = [&](size_t) {
+    TEST_SYNC_POINT("SyncPointTest::Explore:Lock");
+    std::lock_guard lock(m);
+    counter++;
+  };
+  SyncPoint::ExploreOptions options;
+  options.preemption_bound = 0;
+  auto bounded = SyncPoint::GetInstance()->Explore(
+      3, [&]() { counter = 0; }, locked_body, [&]() { return counter == 3; }, options);
+  ASSERT_FALSE(bounded.failed);
+  auto all = SyncPoint::GetInstance()->Explore(
+      3, [&]() { counter = 0; }, locked_body, [&]() { return counter == 3; });
+  ASSERT_FALSE(all.failed);
+  ASSERT_LT(bounded.schedules, all.schedules);
+
+  // independent points are not permuted
+  std::atomic<int> sum = 0;
+  auto independent_body = [&](size_t i) {
+    TEST_SYNC_POINT("SyncPointTest::Explore:Independent:" + std::to_string(i));
+    sum += 1;
+    TEST_SYNC_POINT("SyncPointTest::Explore:Independent:" + std::to_string(i));
+  };
+  options.preemption_bound = 2;
+  options.dependent = [](const std::string& lhs, const std::string& rhs) { return lhs == rhs; };
+  auto reduced = SyncPoint::GetInstance()->Explore(
+      3, [&]() { sum = 0; }, independent_body, [&]() { return sum == 3; }, options);
+  options.dependent = nullptr;
+  auto full = SyncPoint::GetInstance()->Explore(
+      3, [&]() { sum = 0; }, independent_body, [&]() { return sum == 3; }, options);
+  ASSERT_FALSE(reduced.failed);
+  ASSERT_FALSE(full.failed);
+  ASSERT_LT(reduced.schedules, full.schedules);
+
+  // a dependency that can never be met is reported as a deadlock
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {{"SyncPointTest::Explore:Never", "SyncPointTest::Explore:Blocked"}});
+  auto deadlock = SyncPoint::GetInstance()->Explore(
+      1, nullptr, [](size_t) { TEST_SYNC_POINT("SyncPointTest::Explore:Blocked"); }, []() { return true; });
+  ASSERT_TRUE(deadlock.deadlock);
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers({});
+  SyncPoint::GetInstance()->DisableProcessing();
+}
+
+TEST_F(SyncPointTest, MinimizeDependencies) {
+  SyncPoint::GetInstance()->EnableProcessing();
+  // the failure reproduces only while both B and C are blocked
+  auto fails = []() {
+    using Status = SyncPoint::ProcessStatus;
+    auto blocked = [](const std::string& point) {
+      return SyncPoint::GetInstance()->ProcessFor(point, std::chrono::milliseconds(1)) == Status::kTimedOut;
+    };
+    return blocked("SyncPointTest::Min:B") && blocked("SyncPointTest::Min:C");
+  };
+  std::vector<SyncPoint::SyncPointPair> dependencies;
+  for (int i = 0; i < 16; ++i) {
+    dependencies.push_back({"SyncPointTest::Min:Noise" + std::to_string(i), "SyncPointTest::Min:Other"});
+  }
+  dependencies.insert(dependencies.begin() + 5, {"SyncPointTest::Min:A", "SyncPointTest::Min:B"});
+  dependencies.insert(dependencies.begin() + 12, {"SyncPointTest::Min:A", "SyncPointTest::Min:C"});
+
+  for (size_t jobs : {1, 4}) {
+    auto minimal = SyncPoint::GetInstance()->MinimizeDependencies(dependencies, fails, jobs);
+    ASSERT_EQ(minimal.size(), 2);
+    ASSERT_EQ(minimal[0].successor, "SyncPointTest::Min:B");
+    ASSERT_EQ(minimal[1].successor, "SyncPointTest::Min:C");
+  }
+
+  // a child timing out is retried rather than taken as not failing
+  const char* hung = "/tmp/sync_point_test_min_hung";
+  rmdir(hung);
+  auto hangs_once = [&]() {
+    if (mkdir(hung, 0700) == 0) {
+      pause();
+    }
+    return fails();
+  };
+  auto minimal =
+      SyncPoint::GetInstance()->MinimizeDependencies(dependencies, hangs_once, 1, std::chrono::milliseconds(200));
+  ASSERT_EQ(minimal.size(), 2);
+  rmdir(hung);
+  SyncPoint::GetInstance()->DisableProcessing();
+
+  // thread 1 starts once thread 0 has passed A, and thread 0 runs on from C
+  // once thread 1 has passed B
+  std::vector<SyncPoint::SyncPointPair> dependencies_from_schedule;
+  ASSERT_TRUE(SyncPoint::ScheduleToDependencies(
+      {
+          {0, ""},
+          {0, "SyncPointTest::Min:A"},
+          {1, ""},
+          {1, "SyncPointTest::Min:B"},
+          {0, "SyncPointTest::Min:C"},
+      },
+      &dependencies_from_schedule));
+  ASSERT_EQ(dependencies_from_schedule.size(), 2);
+  ASSERT_EQ(dependencies_from_schedule[0].predecessor, "SyncPointTest::Min:A");
+  ASSERT_EQ(dependencies_from_schedule[0].successor, "SyncPointTest::Min:B");
+  ASSERT_EQ(dependencies_from_schedule[1].predecessor, "SyncPointTest::Min:B");
+  ASSERT_EQ(dependencies_from_schedule[1].successor, "SyncPointTest::Min:C");
+
+  // threads hitting the same points cannot be ordered by name
+  std::string report;
+  ASSERT_FALSE(SyncPoint::ScheduleToDependencies(
+      {{0, ""}, {1, ""}, {0, "SyncPointTest::Min:A"}, {1, "SyncPointTest::Min:A"}}, &dependencies_from_schedule,
+      &report));
+  ASSERT_EQ(report, "\"SyncPointTest::Min:A\" is reached more than once (threads 0 and 1)");
+  ASSERT_FALSE(SyncPoint::ScheduleToDependencies({{0, ""}, {0, "SyncPointTest::Min:A"}, {1, ""}},
+                                                 &dependencies_from_schedule, &report));
+  ASSERT_EQ(report, "thread 1 runs after thread 0 but never reaches a sync point");
+}
+
+TEST_F(SyncPointTest, Chaos) {
+  SyncPoint::ChaosOptions slow;
+  slow.sleep_probability = 1;
+  slow.max_sleep = std::chrono::milliseconds(2);
+  SyncPoint::GetInstance()->SetChaos("SyncPointTest::Chaos:Slow*", slow);
+  SyncPoint::ChaosOptions fast;
+  fast.yield_probability = 0.5;
+  SyncPoint::GetInstance()->EnableChaos(42, fast);
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  auto elapsed = [](const std::string& point) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 50; ++i) {
+      TEST_SYNC_POINT(point);
+    }
+    return std::chrono::steady_clock::now() - start;
+  };
+  ASSERT_GT(elapsed("SyncPointTest::Chaos:Slow:1"), std::chrono::milliseconds(10));
+  ASSERT_LT(elapsed("SyncPointTest::Chaos:Fast"), std::chrono::milliseconds(10));
+
+  // a seed reproduces the perturbations hit by hit, told apart by whether
+  // the hit slept; another seed draws others
+  SyncPoint::ChaosOptions coin;
+  coin.sleep_probability = 0.5;
+  coin.max_sleep = std::chrono::milliseconds(1);
+  auto draws = [&](uint64_t seed) {
+    SyncPoint::GetInstance()->EnableChaos(seed, coin);
+    std::vector<bool> slept;
+    std::thread([&]() {
+      for (int i = 0; i < 64; ++i) {
+        rusage before;
+        getrusage(RUSAGE_THREAD, &before);
+        TEST_SYNC_POINT("SyncPointTest::Chaos:Draw:" + std::to_string(i % 4));
+        rusage after;
+        getrusage(RUSAGE_THREAD, &after);
+        slept.push_back(after.ru_nvcsw > before.ru_nvcsw);
+      }
+    }).join();
+    return slept;
+  };
+  auto first = draws(7);
+  ASSERT_NE(std::count(first.begin(), first.end(), true), 0);
+  ASSERT_NE(std::count(first.begin(), first.end(), false), 0);
+  ASSERT_EQ(draws(7), first);
+  ASSERT_NE(draws(8), first);
+
+  SyncPoint::GetInstance()->DisableChaos();
+  ASSERT_LT(elapsed("SyncPointTest::Chaos:Slow:2"), std::chrono::milliseconds(10));
+  SyncPoint::GetInstance()->DisableProcessing();
+}
+
+TEST_F(SyncPointTest, ThreadActions) {
+  SyncPoint::GetInstance()->SetCallBack("SyncPointTest::Actions:Switch", SyncPoint::ContextSwitchAction());
+  SyncPoint::GetInstance()->SetCallBack("SyncPointTest::Actions:Nice", SyncPoint::LowerPriorityAction(1));
+  SyncPoint::GetInstance()->SetCallBack("SyncPointTest::Actions:Migrate", SyncPoint::MigrateThreadAction());
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  std::thread([]() {
+    rusage before;
+    getrusage(RUSAGE_THREAD, &before);
+    TEST_SYNC_POINT("SyncPointTest::Actions:Switch");
+    rusage after;
+    getrusage(RUSAGE_THREAD, &after);
+    ASSERT_GT(after.ru_nvcsw, before.ru_nvcsw);
+
+    auto tid = static_cast<id_t>(syscall(SYS_gettid));
+    int nice = getpriority(PRIO_PROCESS, tid);
+    TEST_SYNC_POINT("SyncPointTest::Actions:Nice");
+    ASSERT_EQ(getpriority(PRIO_PROCESS, tid), std::min(nice + 1, 19));
+  }).join();
+
+  cpu_set_t allowed;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+  if (CPU_COUNT(&allowed) < 2) {
+    SyncPoint::GetInstance()->DisableProcessing();
+    GTEST_SKIP() << "migration needs at least two CPUs";
+  }
+  std::thread([]() {
+    int cpu = sched_getcpu();
+    TEST_SYNC_POINT("SyncPointTest::Actions:Migrate");
+    ASSERT_NE(sched_getcpu(), cpu);
+  }).join();
+  SyncPoint::GetInstance()->DisableProcessing();
+}
+
+TEST_F(SyncPointTest, FaultInjection) {
+  SyncPoint::GetInstance()->EnableProcessing();
+  auto count_failures = [](int calls) {
+    int failures = 0;
+    for (int i = 0; i < calls; ++i) {
+      int num = 0;
+      DummyPlusOneSyncPoint(num);
+      failures += num == 0;
+    }
+    return failures;
+  };
+  const std::string point = "SyncPointTest::DummyPlusOneSyncPoint";
+
+  SyncPoint::FaultSpec nth;
+  nth.nth_hit = 3;
+  SyncPoint::GetInstance()->SetFault(point, nth);
+  ASSERT_EQ(count_failures(2), 0);
+  ASSERT_EQ(count_failures(1), 1);
+  ASSERT_EQ(count_failures(10), 0);
+
+  SyncPoint::FaultSpec every;
+  every.every_k_hits = 4;
+  SyncPoint::GetInstance()->SetFault(point, every);
+  ASSERT_EQ(count_failures(20), 5);
+  ASSERT_EQ(SyncPoint::GetInstance()->GetFaultStats(point).hits, 20);
+  ASSERT_EQ(SyncPoint::GetInstance()->GetFaultStats(point).faults, 5);
+
+  SyncPoint::FaultSpec random;
+  random.probability = 0.25;
+  random.seed = 7;
+  SyncPoint::GetInstance()->SetFault(point, random);
+  int failures = count_failures(10000);
+  ASSERT_GT(failures, 2200);
+  ASSERT_LT(failures, 2800);
+  SyncPoint::GetInstance()->SetFault(point, random);
+  ASSERT_EQ(count_failures(10000), failures);
+
+  SyncPoint::FaultSpec other_thread;
+  other_thread.every_k_hits = 1;
+  std::atomic<bool> armed = false;
+  std::thread thread([&]() {
+    while (!armed) {
+      std::this_thread::yield();
+    }
+    ASSERT_EQ(count_failures(1), 1);
+  });
+  other_thread.thread = thread.get_id();
+  SyncPoint::GetInstance()->SetFault(point, other_thread);
+  ASSERT_EQ(count_failures(10), 0);
+  armed = true;
+  thread.join();
+
+  // a custom fault action overwrites the returned value
+  SyncPoint::FaultSpec value;
+  value.nth_hit = 1;
+  value.on_fault = [](const std::vector<void*>& args) { *static_cast<std::string*>(args[0]) = "Fault"; };
+  SyncPoint::GetInstance()->SetFault("SyncPointTest::DummyReturnHelloSyncPoint", value);
+  ASSERT_EQ(DummyReturnHelloSyncPoint(), "Fault");
+  ASSERT_EQ(DummyReturnHelloSyncPoint(), "Hello");
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+}
+
+#ifdef SYNC_POINT_ALLOCATION_HOOK
+TEST_F(SyncPointTest, AllocationFailure) {
+  SyncPoint::GetInstance()->EnableProcessing();
+  auto allocate = [](int count, int* allocated) {
+    try {
+      for (int i = 0; i < count; ++i) {
+        auto ptr = std::make_unique<int>(i);
+        ++*allocated;
+      }
+    } catch (const std::bad_alloc&) {
+      return false;
+    }
+    return true;
+  };
+
+  // the hooks are added next to existing callbacks, and removed by handle
+  int begin_hits = 0;
+  SyncPoint::GetInstance()->AddCallBack("SyncPointTest::Alloc:Begin", [&](const std::vector<void*>&) { begin_hits++; });
+  auto hooks =
+      SyncPoint::GetInstance()->FailAllocationBetween("SyncPointTest::Alloc:Begin", "SyncPointTest::Alloc:End", 2);
+  int allocated = 0;
+  TEST_SYNC_POINT("SyncPointTest::Alloc:Begin");
+  bool succeeded = allocate(5, &allocated);
+  int* nothrow = new (std::nothrow) int(0);
+  TEST_SYNC_POINT("SyncPointTest::Alloc:End");
+  ASSERT_FALSE(succeeded);
+  ASSERT_EQ(allocated, 1);
+  ASSERT_NE(nothrow, nullptr);
+  delete nothrow;
+  ASSERT_EQ(begin_hits, 1);
+  SyncPoint::GetInstance()->RemoveCallBack(hooks.first);
+  SyncPoint::GetInstance()->RemoveCallBack(hooks.second);
+
+  // the nothrow form returns nullptr
+  hooks = SyncPoint::GetInstance()->FailAllocationBetween("SyncPointTest::Alloc:Begin", "SyncPointTest::Alloc:End", 1);
+  TEST_SYNC_POINT("SyncPointTest::Alloc:Begin");
+  nothrow = new (std::nothrow) int(0);
+  TEST_SYNC_POINT("SyncPointTest::Alloc:End");
+  ASSERT_EQ(nothrow, nullptr);
+  SyncPoint::GetInstance()->RemoveCallBack(hooks.first);
+  SyncPoint::GetInstance()->RemoveCallBack(hooks.second);
+
+  // the end point disarms, and other threads are never armed
+  SyncPoint::GetInstance()->FailAllocationBetween("SyncPointTest::Alloc:Begin", "SyncPointTest::Alloc:End", 3,
+                                                  std::this_thread::get_id());
+  TEST_SYNC_POINT("SyncPointTest::Alloc:Begin");
+  allocated = 0;
+  succeeded = allocate(1, &allocated);
+  TEST_SYNC_POINT("SyncPointTest::Alloc:End");
+  ASSERT_TRUE(succeeded);
+  ASSERT_TRUE(allocate(10, &allocated));
+  std::thread([&]() {
+    int thread_allocated = 0;
+    TEST_SYNC_POINT("SyncPointTest::Alloc:Begin");
+    ASSERT_TRUE(allocate(10, &thread_allocated));
+  }).join();
+  ASSERT_EQ(begin_hits, 4);
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+}
+#endif  // SYNC_POINT_ALLOCATION_HOOK
+
+TEST_F(SyncPointTest, VirtualTime) {
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {{"SyncPointTest::VirtualTime:1", "SyncPointTest::VirtualTime:Wait"}});
+  SyncPoint::GetInstance()->EnableProcessing();
+  SyncPoint::GetInstance()->EnableVirtualTime(3);
+  std::mutex mutex;
+  std::string order;
+  auto append = [&](char c) {
+    std::lock_guard lock(mutex);
+    order.push_back(c);
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  // the third thread is blocked in Process while the first one sleeps, so
+  // it must not hold the clock back
+  std::vector<std::thread> threads;
+  threads.emplace_back([&]() {
+    TEST_SYNC_POINT_SLEEP("SyncPointTest::VirtualTime:Sleep", std::chrono::seconds(3));
+    append('3');
+  });
+  threads.emplace_back([&]() {
+    TEST_SYNC_POINT_SLEEP("SyncPointTest::VirtualTime:Sleep", std::chrono::seconds(1));
+    append('1');
+    TEST_SYNC_POINT("SyncPointTest::VirtualTime:1");
+  });
+  threads.emplace_back([&]() {
+    TEST_SYNC_POINT("SyncPointTest::VirtualTime:Wait");
+    TEST_SYNC_POINT_SLEEP("SyncPointTest::VirtualTime:Sleep", std::chrono::seconds(1));
+    append('2');
+  });
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(order, "123");
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+  ASSERT_EQ(SyncPoint::GetInstance()->VirtualNow(), std::chrono::seconds(3));
+
+  // a participant exiting without ever sleeping or blocking is subtracted
+  SyncPoint::GetInstance()->EnableVirtualTime(3);
+  threads.clear();
+  threads.emplace_back(
+      []() { TEST_SYNC_POINT_SLEEP("SyncPointTest::VirtualTime:Sleep", std::chrono::seconds(2)); });
+  threads.emplace_back(
+      []() { TEST_SYNC_POINT_SLEEP("SyncPointTest::VirtualTime:Sleep", std::chrono::seconds(1)); });
+  threads.emplace_back([]() { TEST_SYNC_POINT("SyncPointTest::VirtualTime:Unordered"); });
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(SyncPoint::GetInstance()->VirtualNow(), std::chrono::seconds(2));
+
+  SyncPoint::GetInstance()->DisableVirtualTime();
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  SyncPoint::GetInstance()->ClearTrace();
+}
+
+TEST_F(SyncPointTest, EventLoop) {
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {{"SyncPointTest::EventLoop:Thread", "SyncPointTest::EventLoop:Loop1"},
+       {"SyncPointTest::EventLoop:Thread", "SyncPointTest::EventLoop:Loop2"}});
+  SyncPoint::GetInstance()->EnableProcessing();
+  int fd = SyncPoint::GetInstance()->CompletionFd();
+  auto readable = [fd](int timeout_ms) {
+    pollfd pfd{fd, POLLIN, 0};
+    return poll(&pfd, 1, timeout_ms) == 1;
+  };
+  ASSERT_FALSE(SyncPoint::GetInstance()->TryProcess("SyncPointTest::EventLoop:Loop1"));
+
+  std::string order;
+  SyncPoint::GetInstance()->ProcessAsync("SyncPointTest::EventLoop:Loop1", [&] { order += "1"; });
+  SyncPoint::GetInstance()->ProcessAsync("SyncPointTest::EventLoop:Loop2", [&] { order += "2"; });
+  SyncPoint::GetInstance()->ProcessAsync("SyncPointTest::EventLoop:Ready", [&] { order += "R"; });
+  ASSERT_TRUE(readable(0));
+  ASSERT_EQ(SyncPoint::GetInstance()->RunCompletions(), 1);
+  ASSERT_EQ(order, "R");
+  ASSERT_FALSE(readable(0));
+
+  // both completions are batched into a single wakeup
+  std::thread([]() { TEST_SYNC_POINT("SyncPointTest::EventLoop:Thread"); }).join();
+  ASSERT_TRUE(readable(1000));
+  ASSERT_EQ(SyncPoint::GetInstance()->RunCompletions(), 2);
+  ASSERT_EQ(order, "R12");
+  ASSERT_FALSE(readable(0));
+  ASSERT_TRUE(SyncPoint::GetInstance()->TryProcess("SyncPointTest::EventLoop:Loop1"));
+
+  // the chain's kThrow is thrown where the point is processed
+  SyncPoint::GetInstance()->SetCallBack("SyncPointTest::EventLoop:Fault",
+                                        [](const std::vector<void*>&) { return SyncPoint::Action::kThrow; });
+  ASSERT_THROW(SyncPoint::GetInstance()->TryProcess("SyncPointTest::EventLoop:Fault"), SyncPoint::InjectedFault);
+
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  SyncPoint::GetInstance()->ClearTrace();
+}
+
+TEST_F(SyncPointTest, MultiProcess) {
+  // |   Parent    |  Child   |
+  // |  Parent:1   |          |
+  // |             | Child:2  |
+  // |  Parent:3   |          |
+  std::string report;
+  ASSERT_TRUE(SyncPoint::GetInstance()->CreateSharedGraph(
+      "/sync_point_test_multi_process",
+      {{"SyncPointTest::MultiProcess:Parent:1", "SyncPointTest::MultiProcess:Child:2"},
+       {"SyncPointTest::MultiProcess:Child:2", "SyncPointTest::MultiProcess:Parent:3"},
+       {"SyncPointTest::MultiProcess:Child:5", "SyncPointTest::MultiProcess:Parent:4"},
+       {"SyncPointTest::MultiProcess:Child:6", "SyncPointTest::MultiProcess:Parent:7"}},
+      &report))
+      << report;
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) {
+    TEST_SYNC_POINT("SyncPointTest::MultiProcess:Child:2");
+    _exit(0);
+  }
+  // the child stays blocked until the parent clears its predecessor
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  int status = 0;
+  ASSERT_EQ(waitpid(child, &status, WNOHANG), 0);
+  // a local successor of a shared point
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers(
+      {{"SyncPointTest::MultiProcess:Parent:3", "SyncPointTest::MultiProcess:Local"}});
+  std::thread local([]() { TEST_SYNC_POINT("SyncPointTest::MultiProcess:Local"); });
+  // an event loop may not go ahead of the child either
+  ASSERT_FALSE(SyncPoint::GetInstance()->TryProcess("SyncPointTest::MultiProcess:Parent:3"));
+  TEST_SYNC_POINT("SyncPointTest::MultiProcess:Parent:1");
+  TEST_SYNC_POINT("SyncPointTest::MultiProcess:Parent:3");
+  local.join();
+  ASSERT_EQ(waitpid(child, &status, 0), child);
+  ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  // the child exited without processing Child:5, so the wait gives up early
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(SyncPoint::GetInstance()->ProcessFor("SyncPointTest::MultiProcess:Parent:4", std::chrono::seconds(10)),
+            SyncPoint::ProcessStatus::kTimedOut);
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+
+  // a child that only clears a point, and only after a while, is waited for
+  child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    TEST_SYNC_POINT("SyncPointTest::MultiProcess:Child:6");
+    _exit(0);
+  }
+  ASSERT_EQ(SyncPoint::GetInstance()->ProcessFor("SyncPointTest::MultiProcess:Parent:7", std::chrono::seconds(5)),
+            SyncPoint::ProcessStatus::kReleased);
+  ASSERT_EQ(waitpid(child, &status, 0), child);
+
+  SyncPoint::GetInstance()->DetachSharedGraph();
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  SyncPoint::GetInstance()->ClearTrace();
+}
+
+#if __cplusplus >= 202002L
+namespace {
+
+// a fire-and-forget coroutine
+struct Task {
+  struct promise_type {
+    Task get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+}  // namespace
+
+TEST_F(SyncPointTest, Coroutine) {
+  constexpr int kTasks = 1000;
+  std::vector<SyncPoint::SyncPointPair> chain;
+  for (int i = 1; i < kTasks; ++i) {
+    chain.push_back(
+        {"SyncPointTest::Coroutine:" + std::to_string(i - 1), "SyncPointTest::Coroutine:" + std::to_string(i)});
+  }
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers(chain);
+  SyncPoint::GetInstance()->EnableProcessing();
+
+  // a single-threaded executor: started in reverse, every task but the
+  // first one suspends on its predecessor
+  std::vector<std::coroutine_handle<>> queue;
+  auto post = [&](std::coroutine_handle<> handle) { queue.push_back(handle); };
+  std::vector<int> order;
+  auto task = [&](int i) -> Task {
+    co_await SyncPoint::Async("SyncPointTest::Coroutine:" + std::to_string(i), post);
+    order.push_back(i);
+  };
+  for (int i = kTasks - 1; i >= 0; --i) {
+    task(i);
+  }
+  ASSERT_EQ(order, std::vector<int>{0});
+  for (size_t i = 0; i < queue.size(); ++i) {
+    queue[i].resume();
+  }
+  ASSERT_EQ(order.size(), kTasks);
+  for (int i = 0; i < kTasks; ++i) {
+    ASSERT_EQ(order[i], i);
+  }
+
+  // the inline executor resumes on the thread processing the predecessor
+  SyncPoint::GetInstance()->ClearTrace();
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers({{"SyncPointTest::Coroutine:A", "SyncPointTest::Coroutine:B"}});
+  std::thread::id resumed_on;
+  auto await_b = [&]() -> Task {
+    co_await SyncPoint::Async("SyncPointTest::Coroutine:B");
+    resumed_on = std::this_thread::get_id();
+  };
+  await_b();
+  ASSERT_EQ(resumed_on, std::thread::id());
+  std::thread thread([]() { TEST_SYNC_POINT("SyncPointTest::Coroutine:A"); });
+  auto thread_id = thread.get_id();
+  thread.join();
+  ASSERT_EQ(resumed_on, thread_id);
+
+  // reloading the graph cancels a suspended awaiter
+  auto status = SyncPoint::ProcessStatus::kTimedOut;
+  auto await_status = [&]() -> Task { status = co_await SyncPoint::Async("SyncPointTest::Coroutine:B"); };
+  SyncPoint::GetInstance()->ClearTrace();
+  await_status();
+  ASSERT_EQ(status, SyncPoint::ProcessStatus::kTimedOut);
+  SyncPoint::GetInstance()->LoadDependencyAndMarkers({});
+  ASSERT_EQ(status, SyncPoint::ProcessStatus::kCancelled);
+
+  SyncPoint::GetInstance()->DisableProcessing();
+  SyncPoint::GetInstance()->ClearAllCallBacks();
+  SyncPoint::GetInstance()->ClearTrace();
 }
+#endif